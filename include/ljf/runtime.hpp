@@ -16,6 +16,15 @@ using Environment = Object;
 using FunctionId = std::size_t;
 
 using FunctionPtr = LJFHandle (*)(Context *ctx, Environment *);
+/// @brief Function receiving its arguments as an array of handles.
+/// @details args has exactly the arity given at registration.
+/// env is the environment passed by the caller; no callee environment is
+/// created for the call.
+using FastFunctionPtr = LJFHandle (*)(Context *ctx, Environment *env,
+                                      const LJFHandle *args);
+/// @brief Max arity of FastFunctionPtr.
+/// Arguments of a fast call are kept in a frame of this size on the stack.
+constexpr std::size_t max_fast_call_arity = 8;
 
 enum TableVisiblity {
     TAB_VISIBLE,
@@ -54,6 +63,8 @@ constexpr LJFAttribute LJF_ATTR_HIDDEN = 1 << 0;
 constexpr LJFAttribute LJF_ATTR_KEY_TYPE_MASK = 0b11 << 3;
 constexpr LJFAttribute LJF_ATTR_C_STR_KEY = 0 << 3;
 constexpr LJFAttribute LJF_ATTR_OBJECT_KEY = 1 << 3;
+// key is a symbol returned by ljf_intern_symbol()
+constexpr LJFAttribute LJF_ATTR_SYMBOL_KEY = 2 << 3;
 //
 //
 constexpr LJFAttribute LJF_ATTR_VALUE_ATTR_MASK = (unsigned long)(UINT32_MAX)
@@ -70,6 +81,47 @@ constexpr LJFAttribute LJF_ATTR_MUTABLE = 0ul << 33;
 constexpr LJFAttribute LJF_ATTR_MAYBE_CONSTANT = 1ul << 33;
 // reserved for future:
 // CONSTANT = 0b10 << 33
+//
+// unboxed value type, bit 35, 36
+// Valid if data type is LJF_ATTR_UNBOXED_OBJECT.
+constexpr LJFAttribute LJF_ATTR_UNBOXED_TYPE_MASK = 0b11ul << 35;
+constexpr LJFAttribute LJF_ATTR_UNBOXED_INT64 = 0ul << 35;
+constexpr LJFAttribute LJF_ATTR_UNBOXED_DOUBLE = 1ul << 35;
+
+/**************** fixnum ***************/
+// Handles of objects are always even. A handle whose bit 0 is set is a fixnum,
+// a 63 bit signed integer encoded as (value << 1) | 1.
+// Fixnums need neither objects nor registration to a context, and runtime API
+// accepts them wherever a handle of an object is accepted.
+// ljf_get() and other API return unboxed int64 values as fixnums if they fit.
+
+constexpr bool ljf_fixnum_fits(int64_t value) {
+    return value >= (INT64_MIN >> 1) && value <= (INT64_MAX >> 1);
+}
+
+constexpr LJFHandle ljf_make_fixnum(int64_t value) {
+    assert(ljf_fixnum_fits(value));
+    return (static_cast<LJFHandle>(value) << 1) | 1;
+}
+
+constexpr bool ljf_is_fixnum(LJFHandle handle) { return handle & 1; }
+
+constexpr int64_t ljf_fixnum_value(LJFHandle handle) {
+    assert(ljf_is_fixnum(handle));
+    // arithmetic shift
+    return static_cast<int64_t>(handle) >> 1;
+}
+
+/// @brief Inline cache of a ljf_get_with_cache/ljf_set_with_cache call site.
+/// @details Compiled code allocates one zero initialized LJFInlineCache for
+/// each call site (eg. as a global variable) and passes it on every call of
+/// the site. A cache is bound to the key of the first call, so the key of a
+/// call site must be the same pointer every time (eg. a string literal).
+/// Once used, the cache is registered to the runtime, so it must never be
+/// freed. Contents are managed by the runtime.
+struct LJFInlineCache {
+    uint64_t opaque[16];
+};
 
 extern "C" {
 LJFHandle ljf_get(ljf::Context *, LJFHandle obj, LJFHandle key,
@@ -78,6 +130,31 @@ LJFHandle ljf_get(ljf::Context *, LJFHandle obj, LJFHandle key,
 void ljf_set(ljf::Context *, LJFHandle obj, LJFHandle key, LJFHandle value,
              LJFAttribute attr);
 
+LJFHandle ljf_get_with_cache(ljf::Context *, LJFHandle obj, LJFHandle key,
+                             LJFAttribute attr, LJFHandle default_value,
+                             LJFInlineCache *cache);
+
+void ljf_set_with_cache(ljf::Context *, LJFHandle obj, LJFHandle key,
+                        LJFHandle value, LJFAttribute attr,
+                        LJFInlineCache *cache);
+
+/// @brief Get an unboxed int64 value without allocating an object.
+/// @details Return default_value if obj doesn't have key.
+/// Throw ljf::runtime_error if the value is not an unboxed int64.
+int64_t ljf_get_int64(ljf::Context *, LJFHandle obj, LJFHandle key,
+                      LJFAttribute attr, int64_t default_value);
+/// @brief Set an unboxed int64 value.
+/// @details Data type bits of attr are ignored.
+/// ljf_get() of the value returns an object boxing it.
+void ljf_set_int64(ljf::Context *, LJFHandle obj, LJFHandle key,
+                   int64_t value, LJFAttribute attr);
+/// @brief double version of ljf_get_int64()
+double ljf_get_double(ljf::Context *, LJFHandle obj, LJFHandle key,
+                      LJFAttribute attr, double default_value);
+/// @brief double version of ljf_set_int64()
+void ljf_set_double(ljf::Context *, LJFHandle obj, LJFHandle key, double value,
+                    LJFAttribute attr);
+
 /**************** function API ***************/
 ljf::FunctionId ljf_get_function_id_from_function_table(ljf::Object *obj,
                                                         const char *key);
@@ -86,6 +163,14 @@ void ljf_set_function_id_to_function_table(ljf::Object *obj, const char *key,
 
 LJFHandle ljf_call_function(ljf::Context *, ljf::FunctionId function_id,
                             LJFHandle env, LJFHandle arg);
+/// @brief Call function with argc arguments.
+/// @details If the function is a fast function of arity argc, arguments are
+/// passed as is and no object is allocated for the call.
+/// Otherwise arguments are pushed to the array of a new argument object
+/// and the function is called by ljf_call_function().
+LJFHandle ljf_call_function_fast(ljf::Context *, ljf::FunctionId function_id,
+                                 LJFHandle env, const LJFHandle *args,
+                                 size_t argc);
 
 /**************** new API ***************/
 LJFHandle ljf_new(ljf::Context *);
@@ -101,8 +186,54 @@ LJFHandle ljf_environment_get(ljf::Context *, ljf::Environment *env,
 void ljf_environment_set(ljf::Context *, ljf::Environment *env, LJFHandle key,
                          LJFHandle value, LJFAttribute attr);
 
+/// @brief Find the variable key in env and its parents.
+/// @details On success, set the number of parent links to follow to *depth,
+/// the slot index in that frame to *slot and the shape of the frame to
+/// *shape, and return true.
+/// Frames of the same shape have the same slot indices, so compiled code can
+/// resolve a variable once and use ljf_environment_get_slot() and
+/// ljf_environment_set_slot() while they succeed. *shape is 0 if the frame
+/// can't be accessed by slot index; then the slot API always fails.
+bool ljf_environment_resolve(ljf::Context *, ljf::Environment *env,
+                             LJFHandle key, LJFAttribute attr, uint64_t *depth,
+                             uint64_t *slot, uint64_t *shape);
+/// @brief Get the variable of (depth, slot) without key lookup to *value.
+/// @return false if the frame of depth doesn't have shape given by
+/// ljf_environment_resolve(). Resolve the variable again then.
+bool ljf_environment_get_slot(ljf::Context *, ljf::Environment *env,
+                              uint64_t depth, uint64_t slot, uint64_t shape,
+                              LJFHandle *value);
+/// @brief Set the variable of (depth, slot) without key lookup.
+/// @return false if the frame of depth doesn't have shape given by
+/// ljf_environment_resolve(). Resolve the variable again then.
+bool ljf_environment_set_slot(ljf::Context *, ljf::Environment *env,
+                              uint64_t depth, uint64_t slot, uint64_t shape,
+                              LJFHandle value, LJFAttribute attr);
+
+/// @brief Environment version of ljf_get_int64()
+int64_t ljf_environment_get_int64(ljf::Context *, ljf::Environment *env,
+                                  LJFHandle key, LJFAttribute attr,
+                                  int64_t default_value);
+/// @brief Environment version of ljf_set_int64()
+void ljf_environment_set_int64(ljf::Context *, ljf::Environment *env,
+                               LJFHandle key, int64_t value,
+                               LJFAttribute attr);
+/// @brief Environment version of ljf_get_double()
+double ljf_environment_get_double(ljf::Context *, ljf::Environment *env,
+                                  LJFHandle key, LJFAttribute attr,
+                                  double default_value);
+/// @brief Environment version of ljf_set_double()
+void ljf_environment_set_double(ljf::Context *, ljf::Environment *env,
+                                LJFHandle key, double value,
+                                LJFAttribute attr);
+
 /**************** function registration API ***************/
 ljf::FunctionId ljf_register_native_function(ljf::FunctionPtr);
+/// @brief Register fast function.
+/// @details If it is called by ljf_call_function(), elements of the array of
+/// the argument object are passed as args.
+ljf::FunctionId ljf_register_native_fast_function(ljf::FastFunctionPtr,
+                                                  size_t arity);
 
 /**************** array API ***************/
 size_t ljf_array_size(ljf::Context *, LJFHandle obj);
@@ -114,4 +245,11 @@ void ljf_array_push(ljf::Context *, LJFHandle obj, LJFHandle value);
 LJFHandle ljf_import(ljf::Context *, const char *src_path,
                      const char *language);
 LJFHandle ljf_wrap_c_str(ljf::Context *, const char *str);
+
+/**************** symbol API ***************/
+/// @brief Get the interned symbol of str.
+/// @details Returned symbol can be passed as key with LJF_ATTR_SYMBOL_KEY
+/// instead of str with LJF_ATTR_C_STR_KEY, and it is valid until the process
+/// exits. Same string returns same symbol.
+LJFHandle ljf_intern_symbol(const char *str);
 }
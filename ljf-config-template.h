@@ -3,4 +3,16 @@
 // edit configuration,
 // and give CONFIG_FILE="ljf-config.h" argument to make.
 
-// #define LJF_CALCULATE_TYPE false
+// #define LJF_CALCULATE_TYPE true
+// #define LJF_ATOMIC_REFCOUNT true
+// #define LJF_DEFERRED_REFCOUNT true
+// #define LJF_SPECIALIZATION_THRESHOLD 1000
+// #define LJF_ORC_JIT false
+// #define LJF_MODULE_OPT_LEVEL 0
+// #define LJF_SPECIALIZATION_OPT_LEVEL 2
+// #define LJF_BACKGROUND_OPT_LEVEL 2
+// #define LJF_COMPILE_THREADS 2
+// #define LJF_CYCLE_COLLECTION true
+// #define LJF_CYCLE_COLLECTION_THRESHOLD 1000000
+// #define LJF_CONCURRENT_CYCLE_COLLECTION true
+// #define LJF_CYCLE_COLLECTION_MAX_PAUSE_OBJECTS 10000
@@ -0,0 +1,68 @@
+#include "CompileQueue.hpp"
+
+#include "config.hpp"
+
+namespace ljf {
+
+CompileQueue::CompileQueue(size_t thread_count)
+    : thread_count_(thread_count > 0 ? thread_count : 1) {}
+
+CompileQueue::~CompileQueue() {
+    {
+        std::lock_guard lk{mutex_};
+        stopped_ = true;
+        tasks_.clear();
+    }
+    task_cv_.notify_all();
+    idle_cv_.notify_all();
+    for (auto &&th : threads_) {
+        th.join();
+    }
+}
+
+void CompileQueue::run() {
+    std::unique_lock lk{mutex_};
+    while (true) {
+        task_cv_.wait(lk, [this] { return stopped_ || !tasks_.empty(); });
+        if (stopped_) {
+            return;
+        }
+        auto task = std::move(tasks_.front());
+        tasks_.pop_front();
+        ++running_count_;
+        lk.unlock();
+        task();
+        lk.lock();
+        --running_count_;
+        if (tasks_.empty() && running_count_ == 0) {
+            idle_cv_.notify_all();
+        }
+    }
+}
+
+void CompileQueue::submit(std::function<void()> task) {
+    std::lock_guard lk{mutex_};
+    if (threads_.empty()) {
+        for (size_t i = 0; i < thread_count_; i++) {
+            threads_.emplace_back([this] { run(); });
+        }
+    }
+    tasks_.push_back(std::move(task));
+    task_cv_.notify_one();
+}
+
+void CompileQueue::wait_idle() {
+    std::unique_lock lk{mutex_};
+    idle_cv_.wait(lk, [this] {
+        return stopped_ || (tasks_.empty() && running_count_ == 0);
+    });
+}
+
+CompileQueue &CompileQueue::global() {
+    // Constructed after static objects of the runtime such as the function
+    // table, so it is destructed before them.
+    static CompileQueue queue{config::compile_threads};
+    return queue;
+}
+
+} // namespace ljf
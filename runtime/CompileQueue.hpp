@@ -0,0 +1,47 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ljf {
+
+/// @brief Thread pool running compile tasks in the background.
+/// @details Threads are started on the first submit(). Tasks must not throw.
+/// On destruction, running tasks are finished and pending tasks are dropped,
+/// because nobody uses their results after exit.
+class CompileQueue {
+private:
+    const size_t thread_count_;
+
+    std::mutex mutex_;
+    std::condition_variable task_cv_;
+    std::condition_variable idle_cv_;
+    std::deque<std::function<void()>> tasks_;
+    size_t running_count_ = 0;
+    bool stopped_ = false;
+    std::vector<std::thread> threads_;
+
+    void run();
+
+public:
+    explicit CompileQueue(size_t thread_count);
+    CompileQueue(const CompileQueue &) = delete;
+    CompileQueue &operator=(const CompileQueue &) = delete;
+    ~CompileQueue();
+
+    void submit(std::function<void()> task);
+
+    /// @brief Wait until all submitted tasks are finished.
+    void wait_idle();
+
+    /// @brief The queue of the runtime, which has config::compile_threads
+    /// threads.
+    static CompileQueue &global();
+};
+
+} // namespace ljf
@@ -0,0 +1,474 @@
+#include "CycleCollector.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <vector>
+
+#include "Object.hpp"
+
+namespace ljf {
+
+void register_object(Object *obj) { CycleCollector::global().add(obj); }
+
+void unregister_object(Object *obj) { CycleCollector::global().remove(obj); }
+
+/// @brief Objects allocated by a thread.
+/// @details Registries are never deleted. When the thread exits, its registry
+/// is adopted by a thread created later, like ThreadCache of PoolAllocator.
+class ObjectRegistry {
+public:
+    std::mutex mutex;
+    // Object::registry_slot_ -> object
+    std::vector<Object *> objects;
+    uint32_t index = 0;
+    ObjectRegistry *next_orphan = nullptr;
+};
+
+namespace {
+thread_local ObjectRegistry *thread_registry = nullptr;
+thread_local bool thread_exiting = false;
+} // namespace
+
+struct ThreadRegistryReleaser {
+    ~ThreadRegistryReleaser() {
+        thread_exiting = true;
+        if (!thread_registry) {
+            return;
+        }
+        CycleCollector::global().release_registry(thread_registry);
+        thread_registry = nullptr;
+    }
+};
+
+namespace {
+thread_local ThreadRegistryReleaser thread_registry_releaser;
+} // namespace
+
+CycleCollector::CycleCollector() {
+    std::lock_guard lk{registries_mutex_};
+    shared_registry_ = create_registry();
+}
+
+CycleCollector &CycleCollector::global() {
+    // Never deleted because objects may be deleted at exit.
+    static auto collector = new CycleCollector;
+    return *collector;
+}
+
+ObjectRegistry &CycleCollector::registry_at(uint32_t index) {
+    auto segment = registry_segments_[index / registry_segment_size].load(
+        std::memory_order_acquire);
+    return segment[index % registry_segment_size];
+}
+
+ObjectRegistry *CycleCollector::create_registry() {
+    auto index = registry_count_.load(std::memory_order_relaxed);
+    if (index == registry_segment_size * max_registry_segments) {
+        throw runtime_error("too many threads for cycle collector");
+    }
+    auto &segment = registry_segments_[index / registry_segment_size];
+    if (index % registry_segment_size == 0) {
+        segment.store(new ObjectRegistry[registry_segment_size],
+                      std::memory_order_release);
+    }
+    auto registry = &segment.load(std::memory_order_relaxed)
+                         [index % registry_segment_size];
+    registry->index = index;
+    registry_count_.store(index + 1, std::memory_order_release);
+    return registry;
+}
+
+ObjectRegistry *CycleCollector::adopt_or_create_registry() {
+    std::lock_guard lk{registries_mutex_};
+    if (!orphans_) {
+        return create_registry();
+    }
+    auto registry = orphans_;
+    orphans_ = registry->next_orphan;
+    registry->next_orphan = nullptr;
+    return registry;
+}
+
+void CycleCollector::release_registry(ObjectRegistry *registry) {
+    std::lock_guard lk{registries_mutex_};
+    registry->next_orphan = orphans_;
+    orphans_ = registry;
+}
+
+ObjectRegistry *CycleCollector::current_registry() {
+    if (thread_registry) {
+        return thread_registry;
+    }
+    if (thread_exiting) {
+        return shared_registry_;
+    }
+    // register destructor of the releaser for this thread.
+    (void)&thread_registry_releaser;
+    thread_registry = adopt_or_create_registry();
+    return thread_registry;
+}
+
+void CycleCollector::add(Object *obj) {
+    {
+        auto registry = current_registry();
+        std::lock_guard lk{registry->mutex};
+        assert(registry->objects.size() < UINT32_MAX);
+        obj->registry_index_ = registry->index;
+        obj->registry_slot_ = static_cast<uint32_t>(registry->objects.size());
+        registry->objects.push_back(obj);
+    }
+
+    // Count allocations in batches to keep the counter uncontended.
+    constexpr std::size_t batch = 256;
+    static thread_local std::size_t local_count = 0;
+    if (++local_count == batch) {
+        allocated_count_.fetch_add(batch, std::memory_order_relaxed);
+        local_count = 0;
+    }
+}
+
+void CycleCollector::remove(Object *obj) {
+    auto &registry = registry_at(obj->registry_index_);
+    std::lock_guard lk{registry.mutex};
+    // Move the last object to the slot of obj.
+    auto last = registry.objects.back();
+    registry.objects[obj->registry_slot_] = last;
+    last->registry_slot_ = obj->registry_slot_;
+    registry.objects.pop_back();
+}
+
+bool CycleCollector::try_pin(Object *obj) {
+    auto count = obj->ref_count_.load(std::memory_order_relaxed);
+    do {
+        if (count == 0) {
+            // Being deleted, or not yet referred by anything.
+            return false;
+        }
+    } while (!obj->ref_count_.compare_exchange_weak(
+        count, count + Object::ref_count_one, std::memory_order_acq_rel));
+    return true;
+}
+
+std::vector<Object *>
+CycleCollector::pin_all(CycleCollectionStatistics &stats) {
+    std::vector<Object *> objects;
+    const auto count = registry_count_.load(std::memory_order_acquire);
+    for (uint32_t i = 0; i < count; i++) {
+        auto &registry = registry_at(i);
+        // Registered objects are not freed while we hold the lock, which
+        // blocks allocation of the thread, so we hold it for a chunk at a
+        // time. Objects moved by remove() meanwhile may be skipped, which
+        // only makes them alive in this collection, or pinned twice.
+        for (std::size_t begin = 0;; begin += pin_chunk_size) {
+            const auto pause_start = std::chrono::steady_clock::now();
+            std::lock_guard lk{registry.mutex};
+            const auto end =
+                std::min(begin + pin_chunk_size, registry.objects.size());
+            for (auto k = begin; k < end; k++) {
+                if (try_pin(registry.objects[k])) {
+                    objects.push_back(registry.objects[k]);
+                }
+            }
+            record_pause(stats, pause_start);
+            if (end == registry.objects.size()) {
+                break;
+            }
+        }
+    }
+    std::sort(objects.begin(), objects.end());
+    // Unpin duplicates. The first pin keeps them alive.
+    std::size_t unique_count = 0;
+    for (auto obj : objects) {
+        if (unique_count > 0 && objects[unique_count - 1] == obj) {
+            decrement_ref_count(obj);
+        } else {
+            objects[unique_count++] = obj;
+        }
+    }
+    objects.resize(unique_count);
+    return objects;
+}
+
+void CycleCollector::record_pause(
+    CycleCollectionStatistics &stats,
+    std::chrono::steady_clock::time_point pause_start) {
+    const auto pause = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - pause_start);
+    ++stats.pauses;
+    stats.max_pause = std::max(stats.max_pause, pause);
+}
+
+namespace {
+/// @return index of obj in sorted objects, or -1
+std::ptrdiff_t index_of(const std::vector<Object *> &objects, Object *obj) {
+    auto it = std::lower_bound(objects.begin(), objects.end(), obj);
+    if (it == objects.end() || *it != obj) {
+        return -1;
+    }
+    return it - objects.begin();
+}
+} // namespace
+
+void CycleCollector::collect_locked(const std::vector<Object *> &objects,
+                                    std::vector<Object *> &to_release,
+                                    CycleCollectionStatistics &stats) {
+    // Objects are locked in address order. Mutators never wait for a lock of
+    // an object while holding a lock of another object except by std::lock,
+    // so they don't deadlock with us. Object::box() is called without locks
+    // for this reason.
+    const auto pause_start = std::chrono::steady_clock::now();
+    for (auto obj : objects) {
+        obj->lock();
+    }
+
+    // Count references from outside of objects.
+    std::vector<std::ptrdiff_t> external_refs(objects.size());
+    for (std::size_t i = 0; i < objects.size(); i++) {
+        auto count = objects[i]->ref_count_.load(std::memory_order_acquire);
+        // Subtract our pin. Handles of the owner context are counted as one.
+        external_refs[i] = count / Object::ref_count_one - 1 +
+                           (count & Object::deferred_owned_bit);
+    }
+    for (auto obj : objects) {
+        obj->foreach_reference([&](Object *child) {
+            auto j = index_of(objects, child);
+            if (j >= 0) {
+                --external_refs[j];
+            }
+        });
+    }
+
+    // Mark objects reachable from the outside.
+    std::vector<bool> reachable(objects.size());
+    std::vector<std::size_t> stack;
+    for (std::size_t i = 0; i < objects.size(); i++) {
+        if (external_refs[i] > 0) {
+            reachable[i] = true;
+            stack.push_back(i);
+        }
+    }
+    while (!stack.empty()) {
+        auto i = stack.back();
+        stack.pop_back();
+        objects[i]->foreach_reference([&](Object *child) {
+            auto j = index_of(objects, child);
+            if (j >= 0 && !reachable[j]) {
+                reachable[j] = true;
+                stack.push_back(j);
+            }
+        });
+    }
+
+    std::vector<Object::ValueType> dropped;
+    for (std::size_t i = 0; i < objects.size(); i++) {
+        if (!reachable[i]) {
+            objects[i]->take_references(dropped);
+            ++stats.collected_objects;
+        }
+    }
+
+    for (auto obj : objects) {
+        obj->unlock();
+    }
+    record_pause(stats, pause_start);
+
+    for (auto &&value : dropped) {
+        if (value.is_object() && value.as_object()) {
+            to_release.push_back(value.as_object());
+        }
+    }
+}
+
+void CycleCollector::record(const CycleCollectionStatistics &stats) {
+    ++collections_;
+    collected_objects_ += stats.collected_objects;
+    pauses_ += stats.pauses;
+    max_pause_ = std::max(max_pause_, stats.max_pause);
+}
+
+CycleCollectionStatistics CycleCollector::collect() {
+    std::unique_lock collect_lk{collect_mutex_, std::try_to_lock};
+    if (!collect_lk.owns_lock()) {
+        return {};
+    }
+    allocated_count_.store(0, std::memory_order_relaxed);
+
+    // Pinned objects are not deleted while we examine them.
+    CycleCollectionStatistics stats;
+    auto objects = pin_all(stats);
+    stats.scanned_objects = objects.size();
+
+    // Garbage is deleted when its last reference, our pin, is released.
+    std::vector<Object *> to_release;
+    collect_locked(objects, to_release, stats);
+    for (auto obj : to_release) {
+        decrement_ref_count(obj);
+    }
+    for (auto obj : objects) {
+        decrement_ref_count(obj);
+    }
+
+    record(stats);
+    return stats;
+}
+
+CycleCollectionStatistics CycleCollector::collect_concurrently() {
+    std::unique_lock collect_lk{collect_mutex_, std::try_to_lock};
+    if (!collect_lk.owns_lock()) {
+        return {};
+    }
+    allocated_count_.store(0, std::memory_order_relaxed);
+
+    CycleCollectionStatistics stats;
+    auto objects = pin_all(stats);
+    const auto n = objects.size();
+    stats.scanned_objects = n;
+
+    // Take a snapshot of references, locking one object at a time.
+    // Mutators change the graph meanwhile, so the snapshot is only used to
+    // find candidates, which collect_locked() confirms.
+    std::vector<std::ptrdiff_t> external_refs(n);
+    std::vector<std::size_t> edges_begin(n + 1);
+    std::vector<std::size_t> edges;
+    for (std::size_t i = 0; i < n; i++) {
+        std::lock_guard lk{*objects[i]};
+        auto count = objects[i]->ref_count_.load(std::memory_order_acquire);
+        external_refs[i] += count / Object::ref_count_one - 1 +
+                            (count & Object::deferred_owned_bit);
+        edges_begin[i] = edges.size();
+        objects[i]->foreach_reference([&](Object *child) {
+            auto j = index_of(objects, child);
+            if (j >= 0) {
+                edges.push_back(j);
+                --external_refs[j];
+            }
+        });
+    }
+    edges_begin[n] = edges.size();
+
+    std::vector<bool> reachable(n);
+    std::vector<std::size_t> stack;
+    for (std::size_t i = 0; i < n; i++) {
+        if (external_refs[i] > 0) {
+            reachable[i] = true;
+            stack.push_back(i);
+        }
+    }
+    while (!stack.empty()) {
+        auto i = stack.back();
+        stack.pop_back();
+        for (auto e = edges_begin[i]; e < edges_begin[i + 1]; e++) {
+            if (!reachable[edges[e]]) {
+                reachable[edges[e]] = true;
+                stack.push_back(edges[e]);
+            }
+        }
+    }
+
+    // Group candidates by connected components, because a part of a cycle
+    // looks referred from the outside by the rest of the cycle.
+    std::vector<std::size_t> parent(n);
+    auto find = [&parent](std::size_t i) {
+        while (parent[i] != i) {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+        return i;
+    };
+    std::vector<std::size_t> candidates;
+    for (std::size_t i = 0; i < n; i++) {
+        parent[i] = i;
+        if (!reachable[i]) {
+            candidates.push_back(i);
+        }
+    }
+    for (auto i : candidates) {
+        for (auto e = edges_begin[i]; e < edges_begin[i + 1]; e++) {
+            if (!reachable[edges[e]]) {
+                parent[find(edges[e])] = find(i);
+            }
+        }
+    }
+    std::stable_sort(candidates.begin(), candidates.end(),
+                     [&find](auto a, auto b) { return find(a) < find(b); });
+
+    std::vector<Object *> to_release;
+    std::vector<Object *> batch;
+    for (std::size_t k = 0; k < candidates.size(); k++) {
+        batch.push_back(objects[candidates[k]]);
+        const bool component_end =
+            k + 1 == candidates.size() ||
+            find(candidates[k + 1]) != find(candidates[k]);
+        if (component_end &&
+            (k + 1 == candidates.size() ||
+             batch.size() >= config::cycle_collection_max_pause_objects)) {
+            std::sort(batch.begin(), batch.end());
+            collect_locked(batch, to_release, stats);
+            batch.clear();
+        }
+    }
+
+    for (auto obj : to_release) {
+        decrement_ref_count(obj);
+    }
+    for (auto obj : objects) {
+        decrement_ref_count(obj);
+    }
+
+    record(stats);
+    return stats;
+}
+
+void CycleCollector::run_background_thread() {
+    std::unique_lock lk{thread_mutex_};
+    for (;;) {
+        thread_cv_.wait(lk, [this] {
+            return stopping_ || requested_.load(std::memory_order_relaxed);
+        });
+        if (stopping_) {
+            return;
+        }
+        lk.unlock();
+        collect_concurrently();
+        requested_.store(false, std::memory_order_relaxed);
+        lk.lock();
+    }
+}
+
+void CycleCollector::request_background_collection() {
+    if (requested_.exchange(true, std::memory_order_relaxed)) {
+        return;
+    }
+    std::lock_guard lk{thread_mutex_};
+    if (stopping_) {
+        return;
+    }
+    if (!thread_.joinable()) {
+        thread_ = std::thread([this] { run_background_thread(); });
+    }
+    thread_cv_.notify_one();
+}
+
+void CycleCollector::stop_background_thread() {
+    {
+        std::lock_guard lk{thread_mutex_};
+        stopping_ = true;
+    }
+    thread_cv_.notify_one();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void CycleCollector::dump_statistics(std::ostream &out) {
+    std::lock_guard lk{collect_mutex_};
+    out << "LJF: cycle collector: collections: " << collections_
+        << ", collected: " << collected_objects_
+        << " objects, pauses: " << pauses_ << ", max pause: "
+        << std::chrono::duration_cast<std::chrono::microseconds>(max_pause_)
+               .count()
+        << " us\n";
+}
+
+} // namespace ljf
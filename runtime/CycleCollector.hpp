@@ -0,0 +1,154 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "config.hpp"
+#include "ljf/internal/object-fwd.hpp"
+
+namespace ljf {
+
+/// @brief Result of a cycle collection.
+struct CycleCollectionStatistics {
+    /// objects examined
+    std::size_t scanned_objects = 0;
+    /// objects deleted because they are only referred by cyclic garbage
+    std::size_t collected_objects = 0;
+    /// number of times objects or registries were locked by the collector
+    std::size_t pauses = 0;
+    /// longest time while objects or a registry were locked by the collector
+    std::chrono::nanoseconds max_pause{0};
+};
+
+class ObjectRegistry;
+
+/// @brief Collector of cyclic garbage, which reference counting can't free.
+/// @details All objects are registered to the registry of the allocating
+/// thread, which the collector merges on collection. A collection
+/// locks objects and subtracts references between them from their reference
+/// counts, so the remaining counts are references from outside: handles of
+/// contexts, ObjectHolders, roots and so on. Objects reachable from such
+/// objects are alive and the others are garbage. References of garbage are
+/// cleared, so reference counting frees them.
+///
+/// collect() locks all objects at once. collect_concurrently() finds
+/// candidates of garbage on a snapshot taken while mutators run, and locks
+/// only the candidates, a few cycles at a time, to confirm them. Mutators
+/// which touch a locked object wait until the collector unlocks it.
+class CycleCollector {
+private:
+    static constexpr std::size_t registry_segment_size = 256;
+    static constexpr std::size_t max_registry_segments = 256;
+
+    // registry index -> registry, allocated by segments.
+    // Registries are never deleted.
+    std::atomic<ObjectRegistry *> registry_segments_[max_registry_segments] =
+        {};
+    std::atomic<uint32_t> registry_count_ = 0;
+    // guards creation of registries and orphans_
+    std::mutex registries_mutex_;
+    // registries released by exited threads
+    ObjectRegistry *orphans_ = nullptr;
+    // used by threads whose registry is already released.
+    ObjectRegistry *shared_registry_;
+
+    std::mutex collect_mutex_;
+    std::atomic<std::size_t> allocated_count_ = 0;
+
+    // totals, guarded by collect_mutex_
+    std::size_t collections_ = 0;
+    std::size_t collected_objects_ = 0;
+    std::size_t pauses_ = 0;
+    std::chrono::nanoseconds max_pause_{0};
+
+    // background collection
+    std::mutex thread_mutex_;
+    std::condition_variable thread_cv_;
+    std::atomic<bool> requested_ = false;
+    bool stopping_ = false;
+    std::thread thread_;
+
+    CycleCollector();
+
+    ObjectRegistry &registry_at(uint32_t index);
+    /// Caller must hold registries_mutex_.
+    ObjectRegistry *create_registry();
+    ObjectRegistry *adopt_or_create_registry();
+    void release_registry(ObjectRegistry *registry);
+    /// @return the registry of the current thread
+    ObjectRegistry *current_registry();
+    friend struct ThreadRegistryReleaser;
+
+    /// @brief Increment refcount of obj unless obj is being deleted.
+    static bool try_pin(Object *obj);
+
+    /// @brief Pin all registered objects and return them in address order.
+    /// @details Each registry is locked for pin_chunk_size objects at a
+    /// time, which is counted as a pause.
+    std::vector<Object *> pin_all(CycleCollectionStatistics &stats);
+
+    static constexpr std::size_t pin_chunk_size = 1024;
+
+    static void
+    record_pause(CycleCollectionStatistics &stats,
+                 std::chrono::steady_clock::time_point pause_start);
+
+    /// @brief Lock objects and clear references of garbage among them.
+    /// @details objects must be sorted by address. Objects referred from
+    /// outside of objects are alive. Caller must decrement objects to
+    /// release in order to delete garbage.
+    void collect_locked(const std::vector<Object *> &objects,
+                        std::vector<Object *> &to_release,
+                        CycleCollectionStatistics &stats);
+
+    void record(const CycleCollectionStatistics &stats);
+
+    void run_background_thread();
+
+public:
+    /// @brief Register obj to the registry of the current thread.
+    /// @details Only the thread and collections lock the registry, so
+    /// allocating threads don't contend with each other.
+    void add(Object *obj);
+    /// @brief Unregister obj from the registry which it was added to.
+    void remove(Object *obj);
+
+    /// @brief Whether enough objects are allocated after the last
+    /// collection to collect automatically.
+    bool collection_requested() const {
+        return config::cycle_collection_threshold != 0 &&
+               allocated_count_.load(std::memory_order_relaxed) >=
+                   config::cycle_collection_threshold;
+    }
+
+    /// @brief Collect cyclic garbage, locking all objects at once.
+    /// @details Caller must not hold locks of objects. If another thread is
+    /// collecting, return without collecting.
+    CycleCollectionStatistics collect();
+
+    /// @brief Collect cyclic garbage, locking at most
+    /// config::cycle_collection_max_pause_objects objects at once unless a
+    /// garbage cycle is larger than it.
+    /// @details Same requirements as collect().
+    CycleCollectionStatistics collect_concurrently();
+
+    /// @brief Wake the background thread to call collect_concurrently().
+    /// The thread is started on the first request.
+    void request_background_collection();
+
+    /// @brief Stop the background thread and wait for it.
+    void stop_background_thread();
+
+    void dump_statistics(std::ostream &out);
+
+    static CycleCollector &global();
+};
+
+} // namespace ljf
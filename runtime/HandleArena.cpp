@@ -0,0 +1,28 @@
+#include "HandleArena.hpp"
+
+namespace ljf {
+
+namespace {
+    struct ArenaReaper {
+        HandleArena *arena = nullptr;
+
+        ~ArenaReaper() {
+            // Contexts of static storage duration may be released after
+            // thread local objects of main thread, so keep the arena alive
+            // if there is a context.
+            if (arena && !arena->owner()) {
+                delete arena;
+            }
+        }
+    };
+} // namespace
+
+HandleArena &HandleArena::current() {
+    static thread_local ArenaReaper reaper;
+    if (!reaper.arena) {
+        reaper.arena = new HandleArena;
+    }
+    return *reaper.arena;
+}
+
+} // namespace ljf
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "ljf/internal/object-fwd.hpp"
+
+namespace ljf {
+
+/// @brief What a context must do for a handle when the context is released.
+enum class HandleKind : uint8_t {
+    /// nothing
+    plain,
+    /// decrement refcount
+    counted,
+    /// release deferred ownership
+    owned,
+};
+
+struct HandleEntry {
+    // LJFHandle is address of this member.
+    Object *obj;
+    HandleKind kind;
+};
+
+/// @brief Per-thread stack of handle entries.
+/// @details Handles are bump-allocated in chunks, so their addresses are
+/// stable. The topmost context takes a mark on creation and pops entries
+/// back to the mark on release. Chunks are reused by later contexts and
+/// freed when the thread exits.
+class HandleArena {
+public:
+    struct Mark {
+        size_t chunk_index;
+        HandleEntry *top;
+    };
+
+private:
+    static constexpr size_t chunk_size = 1024;
+
+    std::vector<std::unique_ptr<HandleEntry[]>> chunks_;
+    size_t chunk_index_ = 0;
+    HandleEntry *top_;
+    HandleEntry *chunk_end_;
+    // context which is allowed to push
+    void *owner_ = nullptr;
+
+    HandleArena() {
+        chunks_.emplace_back(new HandleEntry[chunk_size]);
+        top_ = chunks_[0].get();
+        chunk_end_ = top_ + chunk_size;
+    }
+
+    void next_chunk() {
+        ++chunk_index_;
+        if (chunk_index_ == chunks_.size()) {
+            chunks_.emplace_back(new HandleEntry[chunk_size]);
+        }
+        top_ = chunks_[chunk_index_].get();
+        chunk_end_ = top_ + chunk_size;
+    }
+
+    void prev_chunk() {
+        assert(chunk_index_ > 0);
+        --chunk_index_;
+        // we leave a chunk only when it is full.
+        top_ = chunk_end_ = chunks_[chunk_index_].get() + chunk_size;
+    }
+
+public:
+    HandleArena(const HandleArena &) = delete;
+    HandleArena &operator=(const HandleArena &) = delete;
+
+    /// @brief The arena of the current thread.
+    static HandleArena &current();
+
+    Mark mark() const noexcept { return Mark{chunk_index_, top_}; }
+
+    void *owner() const noexcept { return owner_; }
+    void set_owner(void *owner) noexcept { owner_ = owner; }
+
+    HandleEntry *push(Object *obj, HandleKind kind) {
+        if (top_ == chunk_end_) {
+            next_chunk();
+        }
+        auto entry = top_++;
+        entry->obj = obj;
+        entry->kind = kind;
+        return entry;
+    }
+
+    /// @brief Pop entries pushed after mark in LIFO order and give them to f.
+    template <typename F> void pop_to(const Mark &mark, F &&f) {
+        for (;;) {
+            if (chunk_index_ == mark.chunk_index && top_ == mark.top) {
+                return;
+            }
+            if (top_ == chunks_[chunk_index_].get()) {
+                prev_chunk();
+                continue;
+            }
+            --top_;
+            f(*top_);
+        }
+    }
+};
+
+} // namespace ljf
@@ -0,0 +1,101 @@
+#include "InlineCache.hpp"
+
+namespace ljf {
+
+namespace {
+    // All InlineCaches which have been bound to a key.
+    std::atomic<InlineCache *> site_list_head{nullptr};
+} // namespace
+
+void InlineCache::register_site() {
+    if (registered_.exchange(true)) {
+        return;
+    }
+    auto head = site_list_head.load(std::memory_order_relaxed);
+    do {
+        next_ = head;
+    } while (!site_list_head.compare_exchange_weak(
+        head, this, std::memory_order_release, std::memory_order_relaxed));
+}
+
+InlineCache *InlineCache::first_site() {
+    return site_list_head.load(std::memory_order_acquire);
+}
+
+void InlineCache::add(const Entry &entry) {
+    if (megamorphic_.load(std::memory_order_relaxed)) {
+        return;
+    }
+    for (auto &&e : entries_) {
+        const Entry *expected = nullptr;
+        if (e.load(std::memory_order_acquire)) {
+            continue;
+        }
+        auto new_entry = new Entry(entry);
+        if (e.compare_exchange_strong(expected, new_entry,
+                                      std::memory_order_acq_rel)) {
+            return;
+        }
+        // other thread filled this entry
+        delete new_entry;
+    }
+    megamorphic_.store(true, std::memory_order_relaxed);
+}
+
+InlineCache::State InlineCache::state() const {
+    if (megamorphic_.load(std::memory_order_relaxed)) {
+        return State::MEGAMORPHIC;
+    }
+    if (!entries_[0].load(std::memory_order_relaxed)) {
+        return State::UNINITIALIZED;
+    }
+    if (!entries_[1].load(std::memory_order_relaxed)) {
+        return State::MONOMORPHIC;
+    }
+    return State::POLYMORPHIC;
+}
+
+const char *to_string(InlineCache::State state) {
+    switch (state) {
+    case InlineCache::State::UNINITIALIZED:
+        return "uninitialized";
+    case InlineCache::State::MONOMORPHIC:
+        return "monomorphic";
+    case InlineCache::State::POLYMORPHIC:
+        return "polymorphic";
+    case InlineCache::State::MEGAMORPHIC:
+        return "megamorphic";
+    }
+    return "unknown";
+}
+
+void dump_inline_cache_stats(std::ostream &out, bool per_site) {
+    size_t sites = 0;
+    size_t megamorphic_sites = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+
+    InlineCache::foreach_site([&](const InlineCache &site) {
+        ++sites;
+        if (site.state() == InlineCache::State::MEGAMORPHIC) {
+            ++megamorphic_sites;
+        }
+        hits += site.hit_count();
+        misses += site.miss_count();
+
+        if (per_site) {
+            out << "LJF: inline cache " << &site << ": "
+                << to_string(site.state()) << ", hit: " << site.hit_count()
+                << ", miss: " << site.miss_count() << '\n';
+        }
+    });
+
+    if (sites == 0) {
+        return;
+    }
+    out << "LJF: inline cache: sites: " << sites
+        << ", megamorphic sites: " << megamorphic_sites << ", hit: " << hits
+        << ", miss: " << misses << std::endl;
+}
+
+} // namespace ljf
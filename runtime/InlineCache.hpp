@@ -0,0 +1,141 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+
+#include "ljf/runtime.hpp"
+
+#include "Shape.hpp"
+
+namespace ljf {
+
+/// @brief Runtime side view of LJFInlineCache.
+/// @details An InlineCache belongs to one ljf_get_with_cache or
+/// ljf_set_with_cache call site. It is bound to the key of the first call and
+/// remembers (receiver shape -> slot) pairs seen at the site. Because shapes
+/// are immutable, a remembered pair is valid forever, so a hit needs no key
+/// hashing.
+///
+/// Entries are allocated once and never freed or modified, so readers need
+/// no lock. A site which sees more than max_entries shapes becomes
+/// megamorphic and stops caching.
+///
+/// The memory is given by compiled code as zero initialized LJFInlineCache.
+class InlineCache {
+public:
+    static constexpr size_t max_entries = 4;
+
+    struct Entry {
+        // shape of the receiver object before the access
+        const Shape *shape;
+        // shape of the receiver object after the access.
+        // This differs from shape only when ljf_set added a new key.
+        const Shape *new_shape;
+        size_t slot;
+    };
+
+    enum class State {
+        UNINITIALIZED,
+        MONOMORPHIC,
+        POLYMORPHIC,
+        MEGAMORPHIC,
+    };
+
+private:
+    std::atomic<const void *> key_;
+    std::atomic<LJFAttribute> attr_;
+    std::atomic<const Entry *> entries_[max_entries];
+    std::atomic<uint64_t> hit_count_;
+    std::atomic<uint64_t> miss_count_;
+    std::atomic<bool> megamorphic_;
+    std::atomic<bool> registered_;
+    InlineCache *next_;
+
+    // key_ while a thread is binding the site, never a valid key
+    static constexpr char binding_ = 0;
+
+    void register_site();
+
+    // Counters are statistics only, so we accept lost updates from
+    // concurrent threads instead of paying for atomic read-modify-write.
+    static void increment(std::atomic<uint64_t> &counter) {
+        counter.store(counter.load(std::memory_order_relaxed) + 1,
+                      std::memory_order_relaxed);
+    }
+
+public:
+    InlineCache() = delete;
+    InlineCache(const InlineCache &) = delete;
+    InlineCache &operator=(const InlineCache &) = delete;
+
+    static InlineCache &from(LJFInlineCache *cache) {
+        return *reinterpret_cast<InlineCache *>(cache);
+    }
+
+    /// @brief Bind this site to key on the first call.
+    /// @return true if key is the key this site is bound to.
+    bool bind_key(const void *key, LJFAttribute attr) {
+        auto bound = key_.load(std::memory_order_acquire);
+        if (!bound) {
+            // Reserve the site first, so that the key is published together
+            // with its attr. Other threads miss while we are binding.
+            if (key_.compare_exchange_strong(bound, &binding_,
+                                             std::memory_order_acquire)) {
+                attr_.store(attr, std::memory_order_relaxed);
+                key_.store(key, std::memory_order_release);
+                register_site();
+                return true;
+            }
+        }
+        return bound == key &&
+               attr_.load(std::memory_order_relaxed) == attr;
+    }
+
+    const Entry *find(const Shape *shape) const {
+        for (auto &&e : entries_) {
+            auto entry = e.load(std::memory_order_acquire);
+            if (!entry) {
+                return nullptr;
+            }
+            if (entry->shape == shape) {
+                return entry;
+            }
+        }
+        return nullptr;
+    }
+
+    void add(const Entry &entry);
+
+    void count_hit() { increment(hit_count_); }
+    void count_miss() { increment(miss_count_); }
+
+    uint64_t hit_count() const {
+        return hit_count_.load(std::memory_order_relaxed);
+    }
+    uint64_t miss_count() const {
+        return miss_count_.load(std::memory_order_relaxed);
+    }
+
+    State state() const;
+
+    /// @brief Call f(const InlineCache &) for all sites which have been used.
+    template <typename Function> static void foreach_site(Function &&f);
+
+    static InlineCache *first_site();
+    InlineCache *next_site() const { return next_; }
+};
+
+static_assert(sizeof(InlineCache) <= sizeof(LJFInlineCache));
+
+template <typename Function> void InlineCache::foreach_site(Function &&f) {
+    for (auto site = first_site(); site; site = site->next_site()) {
+        f(static_cast<const InlineCache &>(*site));
+    }
+}
+
+const char *to_string(InlineCache::State state);
+
+void dump_inline_cache_stats(std::ostream &out, bool per_site);
+
+} // namespace ljf
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <assert.h>
+#include <functional>
+#include <string_view>
+
+#include "ljf/runtime.hpp"
+
+#include "AttributeTraits.hpp"
+#include "Symbol.hpp"
+
+namespace ljf {
+class Object;
+
+/// @brief Key of object tables.
+/// @details String keys (LJF_ATTR_C_STR_KEY and LJF_ATTR_SYMBOL_KEY) are
+/// hashed by contents, so a C string key finds the same entry as the Symbol
+/// of the string without interning it. Keys stored by tables are interned(),
+/// so they never refer to strings of callers and compare by address.
+/// Object keys are compared by identity.
+class Key {
+private:
+    LJFAttribute attr_;
+    // const char *, const Symbol * or const Object * by the key type
+    const void *key_;
+    // hash of the string for string keys
+    size_t hash_;
+
+    LJFAttribute mask_key_type_attr() const {
+        return AttributeTraits::mask(attr_, LJF_ATTR_KEY_TYPE_MASK);
+    }
+
+    // key attributes except the key type
+    LJFAttribute mask_key_attr_without_type() const {
+        return AttributeTraits::mask(
+            attr_, LJF_ATTR_KEY_ATTR_MASK & ~LJF_ATTR_KEY_TYPE_MASK);
+    }
+
+    static LJFAttribute with_key_type(LJFAttribute attr,
+                                      LJFAttribute key_type) {
+        return AttributeTraits::or_attr(
+            AttributeTraits::mask(attr, ~LJF_ATTR_KEY_TYPE_MASK), key_type);
+    }
+
+    std::string_view string() const {
+        return is_symbol_key() ? get_key_as_symbol()->name()
+                               : std::string_view(get_key_as_c_str());
+    }
+
+public:
+    /// @param attr
+    /// @param key C string, Symbol or Object according to the key type of
+    /// attr. A C string must live while this key is used.
+    Key(LJFAttribute attr, const void *key) : attr_(attr), key_(key) {
+        const auto key_type = mask_key_type_attr();
+        if (key_type == LJF_ATTR_C_STR_KEY) {
+            hash_ = Symbol::hash(static_cast<const char *>(key));
+        } else if (key_type == LJF_ATTR_SYMBOL_KEY) {
+            hash_ = static_cast<const Symbol *>(key)->hash();
+        } else if (key_type == LJF_ATTR_OBJECT_KEY) {
+            hash_ = std::hash<const void *>()(key);
+        } else {
+            throw ljf::runtime_error("invalid key type");
+        }
+    }
+
+    Key(LJFAttribute attr, const Symbol *symbol)
+        : attr_(with_key_type(attr, LJF_ATTR_SYMBOL_KEY)), key_(symbol),
+          hash_(symbol->hash()) {}
+
+    Key() = default;
+    Key(const Key &) = default;
+    Key(Key &&) = default;
+    Key &operator=(const Key &) = default;
+    Key &operator=(Key &&) = default;
+
+    bool is_c_str_key() const {
+        return mask_key_type_attr() == LJF_ATTR_C_STR_KEY;
+    }
+    bool is_symbol_key() const {
+        return mask_key_type_attr() == LJF_ATTR_SYMBOL_KEY;
+    }
+    bool is_object_key() const {
+        return mask_key_type_attr() == LJF_ATTR_OBJECT_KEY;
+    }
+
+    /// @brief Get the key whose string is interned as a Symbol.
+    /// @details Tables store interned keys. Lookups don't need it.
+    Key interned() const {
+        if (!is_c_str_key()) {
+            return *this;
+        }
+        return Key{attr_, Symbol::intern(get_key_as_c_str())};
+    }
+
+    const Symbol *get_key_as_symbol() const {
+        assert(is_symbol_key());
+        return static_cast<const Symbol *>(key_);
+    }
+    const char *get_key_as_c_str() const {
+        if (is_c_str_key()) {
+            return static_cast<const char *>(key_);
+        }
+        return get_key_as_symbol()->c_str();
+    }
+    const Object *get_key_as_object() const {
+        assert(is_object_key());
+        return static_cast<const Object *>(key_);
+    }
+
+    size_t hash_code() const { return hash_; }
+
+    bool operator==(const Key &other) const {
+        if (hash_ != other.hash_ ||
+            mask_key_attr_without_type() !=
+                other.mask_key_attr_without_type()) {
+            return false;
+        }
+        if (is_object_key() || other.is_object_key()) {
+            return key_ == other.key_ && is_object_key() &&
+                   other.is_object_key();
+        }
+        if (is_symbol_key() && other.is_symbol_key()) {
+            return key_ == other.key_;
+        }
+        return string() == other.string();
+    }
+};
+} // namespace ljf
+
+template <> struct std::hash<ljf::Key> {
+    size_t operator()(const ljf::Key &key) const { return key.hash_code(); }
+};
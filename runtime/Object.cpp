@@ -1,4 +1,7 @@
 #include "Object.hpp"
+#include "ThreadToken.hpp"
+#include "ljf-system-property.hpp"
+#include "config.hpp"
 #include "runtime-internal.hpp"
 
 namespace ljf {
@@ -6,9 +9,19 @@ namespace ljf {
 using namespace internal;
 
 void increment_ref_count(Object *obj) {
-    if (obj != ljf_internal_nullptr) {
-        std::lock_guard lk{*obj};
-        obj->ref_count_++;
+    if (obj == ljf_internal_nullptr) {
+        return;
+    }
+
+    if constexpr (config::atomic_refcount) {
+        // Incrementing needs no ordering because the caller already has a
+        // reference.
+        obj->ref_count_.fetch_add(Object::ref_count_one,
+                                  std::memory_order_relaxed);
+    } else {
+        obj->ref_count_.store(obj->ref_count_.load(std::memory_order_relaxed) +
+                                  Object::ref_count_one,
+                              std::memory_order_relaxed);
     }
 }
 
@@ -19,20 +32,96 @@ void decrement_ref_count(Object *obj) {
         return;
     }
 
-    obj->lock();
-    assert(obj->ref_count_ > 0);
-    obj->ref_count_--;
-    if (obj->ref_count_ == 0) {
-        obj->unlock();
+    size_t old_count;
+    if constexpr (config::atomic_refcount) {
+        // Release makes our writes to obj visible to the thread deleting
+        // obj, and acquire makes writes of other threads visible to us if
+        // we delete obj.
+        old_count = obj->ref_count_.fetch_sub(Object::ref_count_one,
+                                              std::memory_order_acq_rel);
+    } else {
+        old_count = obj->ref_count_.load(std::memory_order_relaxed);
+        obj->ref_count_.store(old_count - Object::ref_count_one,
+                              std::memory_order_relaxed);
+    }
+    assert(old_count >= Object::ref_count_one);
+
+    // If obj is owned by a context, the context will delete obj.
+    if (old_count == Object::ref_count_one) {
         delete obj;
+    }
+}
+
+DeferredOwnership acquire_deferred_ownership(Object *obj,
+                                             uint64_t context_seq) {
+    if (obj == ljf_internal_nullptr) {
+        // nothing to hold
+        return DeferredOwnership::owned;
+    }
 
-        // Commented out for experimentation.
-        //
-        // assert(allocated_memory_size >= sizeof(Object));
-        // allocated_memory_size -= sizeof(Object);
+    auto self = current_thread_token();
+    auto owner = obj->deferred_owner_thread_.load(std::memory_order_acquire);
+    if (owner == self) {
+        if (context_seq < obj->deferred_owner_seq_) {
+            // Move ownership to the older context because it is released
+            // after the current owner.
+            obj->deferred_owner_seq_ = context_seq;
+            return DeferredOwnership::acquired;
+        }
+        return DeferredOwnership::owned;
+    }
+
+    if (owner != 0 || !obj->deferred_owner_thread_.compare_exchange_strong(
+                          owner, self, std::memory_order_acq_rel)) {
+        return DeferredOwnership::not_owned;
+    }
+    obj->deferred_owner_seq_ = context_seq;
+    // While the bit is not set, obj is kept alive by the caller.
+    obj->ref_count_.fetch_or(Object::deferred_owned_bit,
+                             std::memory_order_acq_rel);
+    return DeferredOwnership::acquired;
+}
+
+void release_deferred_ownership(Object *obj, uint64_t context_seq) {
+    // A context inherits the seq of an older context released before it, so
+    // it also owns objects acquired with its original seq.
+    if (obj->deferred_owner_thread_.load(std::memory_order_relaxed) !=
+            current_thread_token() ||
+        obj->deferred_owner_seq_ < context_seq) {
+        // Ownership was moved to an older context.
         return;
     }
-    obj->unlock();
+
+    // Hold a temporary reference, because once the bit is cleared other
+    // threads may drop their references and delete obj.
+    obj->ref_count_.fetch_add(Object::ref_count_one, std::memory_order_relaxed);
+    // Clear the bit before the owner so that other threads can't set the bit
+    // before we clear it.
+    obj->ref_count_.fetch_and(~Object::deferred_owned_bit,
+                              std::memory_order_acq_rel);
+    obj->deferred_owner_thread_.store(0, std::memory_order_release);
+    // Delete obj if only handles of the owner referred it.
+    decrement_ref_count(obj);
+}
+
+IncrementedObjectPtr Object::box(const ValueType &value) {
+    auto boxed = new Object(value.as_native_value());
+    increment_ref_count(boxed);
+
+    // Mark the type of native data as same as other boxed values.
+    ObjectHolder data = new Object(value.as_native_value());
+    set_object_to_hidden_table(boxed,
+                               value.is_int64() ? ljf_native_value_int64
+                                                : ljf_native_value_double,
+                               data.get());
+    return static_cast<IncrementedObjectPtr>(
+        reinterpret_cast<uintptr_t>(boxed));
+}
+
+Object *Context::box_fixnum(LJFHandle fixnum) {
+    auto boxed = Object::box(Object::ValueType::from_int64(
+        LJF_ATTR_DEFAULT, ljf_fixnum_value(fixnum)));
+    return get_from_handle(register_temporary_object(std::move(boxed)));
 }
 
 LJFHandle ObjectHolder::get_handle(Context &ctx) const {
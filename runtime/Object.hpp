@@ -1,9 +1,15 @@
 #pragma once
 
+#include <algorithm>
 #include <assert.h>
+#include <cstring>
+#include <atomic>
 #include <functional>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
 #include <mutex>
+#include <optional>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
@@ -12,89 +18,24 @@
 #include "ljf/runtime.hpp"
 
 #include "AttributeTraits.hpp"
+#include "InlineCache.hpp"
+#include "Key.hpp"
 #include "ObjectHolder.hpp"
+#include "PoolAllocator.hpp"
+#include "Shape.hpp"
+#include "ThinLock.hpp"
+#include "TypeObject.hpp"
 #include "ljf/internal/object-fwd.hpp"
 #include "runtime-internal.hpp"
 
-namespace ljf {
-class Object;
-
-class Key {
-private:
-    LJFAttribute attr_;
-    const void *key_;
-
-    LJFAttribute mask_key_attr() const {
-        return AttributeTraits::mask(attr_, LJF_ATTR_KEY_ATTR_MASK);
-    }
-
-    LJFAttribute mask_key_type_attr() const {
-        return AttributeTraits::mask(attr_, LJF_ATTR_KEY_TYPE_MASK);
-    }
-
-public:
-    Key(LJFAttribute attr, const void *key) : attr_(attr), key_(key) {}
-
-    Key() = default;
-    Key(const Key &) = default;
-    Key(Key &&) = default;
-    Key &operator=(const Key &) = default;
-    Key &operator=(Key &&) = default;
-
-    bool is_c_str_key() const {
-        return mask_key_type_attr() == LJF_ATTR_C_STR_KEY;
-    }
-    bool is_object_key() const {
-        return mask_key_type_attr() == LJF_ATTR_OBJECT_KEY;
-    }
-
-    const char *get_key_as_c_str() const {
-        assert(is_c_str_key());
-        return static_cast<const char *>(key_);
-    }
-    const Object *get_key_as_object() const {
-        assert(is_object_key());
-        return static_cast<const Object *>(key_);
-    }
-
-    size_t hash_code() const {
-        if (is_c_str_key()) {
-            return std::hash<std::string_view>()(
-                std::string_view(get_key_as_c_str()));
-        } else {
-            throw "not implemented";
-        }
-    }
-
-    bool operator==(const Key &other) const {
-
-        if (mask_key_attr() != other.mask_key_attr()) {
-            return false;
-        }
-        if (is_c_str_key()) {
-            return std::string_view(get_key_as_c_str()) ==
-                   std::string_view(other.get_key_as_c_str());
-        } else {
-            throw "not implemented";
-        }
-    }
-};
-} // namespace ljf
-
-template <> struct std::hash<ljf::Key> {
-    size_t operator()(const ljf::Key &key) const { return key.hash_code(); }
-};
-
 namespace ljf {
 using ObjectPtr = Object *;
 
-class TypeObject;
-struct TypeCalcData {
-    std::unordered_set<Object *> objects_in_calculation;
-};
-
-std::shared_ptr<TypeObject> calculate_type(Object &obj);
-std::shared_ptr<TypeObject> calculate_type(Object &obj, TypeCalcData &);
+class CycleCollector;
+/// @brief Register obj to CycleCollector::global().
+void register_object(Object *obj);
+/// @brief Unregister obj from CycleCollector::global().
+void unregister_object(Object *obj);
 
 class Object {
 public:
@@ -137,79 +78,381 @@ public:
             assert(!is_object());
             return static_cast<uint64_t>(value_);
         }
+
+        static ValueType from_int64(LJFAttribute attr, int64_t value) {
+            return ValueType(unboxed_attr(attr, LJF_ATTR_UNBOXED_INT64),
+                             static_cast<ObjectPtrOrNativeValue>(value));
+        }
+
+        static ValueType from_double(LJFAttribute attr, double value) {
+            uint64_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            return ValueType(unboxed_attr(attr, LJF_ATTR_UNBOXED_DOUBLE),
+                             static_cast<ObjectPtrOrNativeValue>(bits));
+        }
+
+        bool is_int64() const {
+            return !is_object() &&
+                   AttributeTraits::mask(attr_, LJF_ATTR_UNBOXED_TYPE_MASK) ==
+                       LJF_ATTR_UNBOXED_INT64;
+        }
+
+        bool is_double() const {
+            return !is_object() &&
+                   AttributeTraits::mask(attr_, LJF_ATTR_UNBOXED_TYPE_MASK) ==
+                       LJF_ATTR_UNBOXED_DOUBLE;
+        }
+
+        int64_t as_int64() const {
+            assert(is_int64());
+            return static_cast<int64_t>(as_native_value());
+        }
+
+        double as_double() const {
+            assert(is_double());
+            auto bits = as_native_value();
+            double value;
+            std::memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+
+    private:
+        static LJFAttribute unboxed_attr(LJFAttribute attr,
+                                         LJFAttribute unboxed_type) {
+            return AttributeTraits::or_attr(
+                AttributeTraits::mask(attr, ~(LJF_ATTR_DATA_TYPE_MASK |
+                                              LJF_ATTR_UNBOXED_TYPE_MASK)),
+                LJF_ATTR_UNBOXED_OBJECT, unboxed_type);
+        }
     };
 
 private:
-    std::recursive_mutex mutex_;
-    size_t version_ = 0;
-    std::shared_ptr<TypeObject> type_object_;
-    std::unordered_map<Key, size_t> hash_table_;
-    std::vector<ValueType> array_table_;
-    std::vector<ObjectPtr> array_;
-    std::unordered_map<std::string, FunctionId> function_id_table_;
+    /// Rarely used parts of Object, allocated on first use.
+    struct Extension {
+        std::vector<ValueType> array;
+        std::unordered_map<std::string, FunctionId> function_id_table;
+        bool is_environment = false;
+        // lexically enclosing environment, held by this object.
+        Object *environment_parent = nullptr;
+        // Used instead of shape_ in dictionary mode. Object keys are held by
+        // this object.
+        // key -> slot index
+        std::unordered_map<Key, size_t> dictionary;
+        // slot index -> key
+        std::vector<Key> dictionary_keys;
+    };
+
+    ThinLock mutex_;
+    uint32_t version_ = 0;
+    uint32_t slot_capacity_ = 0;
+    const Shape *shape_ = Shape::root();
+    // updated with shape_ and values
+    const TypeObject *type_ = TypeObject::root();
+    // slot index (given by shape_) -> value
+    ValueType *slots_ = nullptr;
+    std::unique_ptr<Extension> ext_;
     const native_data_t native_data_ = 0;
-    ssize_t ref_count_ = 0;
+    // (reference count << 1) | deferred_owned_bit
+    std::atomic<size_t> ref_count_{0};
+    // See acquire_deferred_ownership()
+    static constexpr size_t deferred_owned_bit = 1;
+    static constexpr size_t ref_count_one = 2;
+    std::atomic<uintptr_t> deferred_owner_thread_{0};
+    // seq of owner context, accessed only by the owner thread.
+    uint64_t deferred_owner_seq_ = 0;
+    // position in the registries of CycleCollector.
+    uint32_t registry_index_ = 0;
+    uint32_t registry_slot_ = 0;
 
 public:
-    Object() = default;
-    explicit Object(native_data_t data) : native_data_(data) {}
+    Object() {
+        if constexpr (config::cycle_collection) {
+            register_object(this);
+        }
+    }
+    explicit Object(native_data_t data) : native_data_(data) {
+        if constexpr (config::cycle_collection) {
+            register_object(this);
+        }
+    }
     Object(const Object &) = delete;
     Object(Object &&) = delete;
     Object &operator=(const Object &) = delete;
     Object &operator=(Object &&) = delete;
 
+    static void *operator new(size_t size) { return pool_allocate(size); }
+    static void operator delete(void *ptr, size_t size) noexcept {
+        pool_deallocate(ptr, size);
+    }
+
     void swap(Object &other) {
         std::scoped_lock lk{*this, other};
 
-        type_object_.swap(other.type_object_);
-        hash_table_.swap(other.hash_table_);
-        array_table_.swap(other.array_table_);
-        array_.swap(other.array_);
-        function_id_table_.swap(other.function_id_table_);
+        std::swap(shape_, other.shape_);
+        std::swap(type_, other.type_);
+        std::swap(slots_, other.slots_);
+        std::swap(slot_capacity_, other.slot_capacity_);
+        ext_.swap(other.ext_);
 
         ++version_;
         ++other.version_;
     }
 
+private:
+    /// Caller must hold lock.
+    Extension &ext() {
+        if (!ext_) {
+            ext_ = std::make_unique<Extension>();
+        }
+        return *ext_;
+    }
+
+    /// Caller must hold lock.
+    void reserve_slots(size_t size) {
+        if (size <= slot_capacity_) {
+            return;
+        }
+        auto new_capacity = std::max<size_t>(size, slot_capacity_ * 2);
+        auto new_slots = new ValueType[new_capacity];
+        std::copy(slots_, slots_ + slot_capacity_, new_slots);
+        delete[] slots_;
+        slots_ = new_slots;
+        slot_capacity_ = new_capacity;
+    }
+
+    /// Caller must hold lock.
+    bool is_dictionary() const { return shape_->is_dictionary(); }
+
+    /// Caller must hold lock.
+    size_t slot_count() const {
+        return is_dictionary() ? ext_->dictionary_keys.size()
+                               : shape_->size();
+    }
+
+    /// Caller must hold lock.
+    std::optional<size_t> lookup_slot(const Key &key) const {
+        if (!is_dictionary()) {
+            return shape_->find_slot(key);
+        }
+        auto it = ext_->dictionary.find(key);
+        if (it == ext_->dictionary.end()) {
+            return std::nullopt;
+        }
+        return it->second;
+    }
+
+    /// Caller must hold lock.
+    const Key &key_at(size_t slot) const {
+        return is_dictionary() ? ext_->dictionary_keys.at(slot)
+                               : shape_->key_at(slot);
+    }
+
+    /// @brief Move keys of shape_ to the dictionary of this object.
+    /// Caller must hold lock.
+    void make_dictionary() {
+        auto &ext = this->ext();
+        for (size_t slot = 0; slot < shape_->size(); slot++) {
+            ext.dictionary_keys.push_back(shape_->key_at(slot));
+            ext.dictionary.emplace(ext.dictionary_keys.back(), slot);
+        }
+        shape_ = Shape::dictionary();
+        type_ = type_->with_slot(shape_, 0, ValueKind::none);
+    }
+
+    /// Caller must hold lock.
+    size_t add_dictionary_key(const Key &key) {
+        auto &ext = *ext_;
+        auto slot = ext.dictionary_keys.size();
+        if (key.is_object_key()) {
+            increment_ref_count(const_cast<Object *>(key.get_key_as_object()));
+        }
+        ext.dictionary_keys.push_back(key);
+        ext.dictionary.emplace(key, slot);
+        reserve_slots(slot + 1);
+        return slot;
+    }
+
+    /// @brief Caller must hold lock.
+    /// @return value of slot. If it is an object, it is incremented.
+    ValueType load_slot(size_t slot) {
+        assert(slot < slot_count());
+        auto value = slots_[slot];
+        //  We have to increment returned object because:
+        //      returned object will released if other thread decrement
+        //      refcount
+        increment_ref_count_if_object(value);
+        return value;
+    }
+
+    /// Caller must hold lock.
+    void store_slot(size_t slot, const ValueType &value) {
+        increment_ref_count_if_object(value);
+        decrement_ref_count_if_object(slots_[slot]);
+        slots_[slot] = value;
+        type_ = type_->with_slot(shape_, slot, kind_of(value));
+        ++version_;
+    }
+
+    /// Caller must hold lock.
+    void transit_shape(const Shape *new_shape) {
+        shape_ = new_shape;
+        reserve_slots(new_shape->size());
+    }
+
+    /// Caller must hold lock.
+    size_t find_or_add_slot(const Key &key) {
+        if (auto slot = lookup_slot(key)) {
+            return *slot;
+        }
+        // Only keys stored by tables are interned.
+        const auto interned_key = key.interned();
+        if (!is_dictionary()) {
+            if (auto new_shape = shape_->add_key(interned_key)) {
+                transit_shape(new_shape);
+                return shape_->size() - 1;
+            }
+            make_dictionary();
+        }
+        return add_dictionary_key(interned_key);
+    }
+
+public:
+    /// @brief Make a new object holding an unboxed value.
+    static IncrementedObjectPtr box(const ValueType &value);
+
+    /// @param value incremented object or unboxed value
+    static IncrementedObjectPtr
+    to_incremented_object(const std::optional<ValueType> &value) {
+        if (!value) {
+            return IncrementedObjectPtr::NULL_PTR;
+        }
+        if (!value->is_object()) {
+            return box(*value);
+        }
+        return static_cast<IncrementedObjectPtr>(
+            reinterpret_cast<uintptr_t>(value->as_object()));
+    }
+
+    /// @brief Get value of key.
+    /// @return std::nullopt if this object doesn't have key.
+    /// If the value is an object, it is incremented and caller must
+    /// decrement it.
+    std::optional<ValueType> get_value(const void *key, LJFAttribute attr) {
+        Key key_obj{attr, key};
+
+        std::lock_guard lk{mutex_};
+        auto slot = lookup_slot(key_obj);
+        if (!slot) {
+            return std::nullopt;
+        }
+        return load_slot(*slot);
+    }
+
+    /// @brief get_value() using inline cache of the call site.
+    std::optional<ValueType> get_value(const void *key, LJFAttribute attr,
+                                       InlineCache &cache) {
+        if (!cache.bind_key(key, attr)) {
+            cache.count_miss();
+            return get_value(key, attr);
+        }
+
+        std::lock_guard lk{mutex_};
+        if (auto entry = cache.find(shape_)) {
+            cache.count_hit();
+            return load_slot(entry->slot);
+        }
+
+        cache.count_miss();
+        auto slot = lookup_slot(Key{attr, key});
+        if (!slot) {
+            return std::nullopt;
+        }
+        if (!is_dictionary()) {
+            cache.add({shape_, shape_, *slot});
+        }
+        return load_slot(*slot);
+    }
+
+    /// @brief Get value of key as an object. Unboxed value is boxed.
     IncrementedObjectPtr get(const void *key, LJFAttribute attr) {
+        return to_incremented_object(get_value(key, attr));
+    }
+
+    /// @brief get() using inline cache of the call site.
+    IncrementedObjectPtr get(const void *key, LJFAttribute attr,
+                             InlineCache &cache) {
+        return to_incremented_object(get_value(key, attr, cache));
+    }
+
+    void set_value(const void *key, const ValueType &value,
+                   LJFAttribute attr) {
         Key key_obj{attr, key};
 
-        {
-            std::lock_guard lk{mutex_};
-            auto it = hash_table_.find(key_obj);
-            if (it == hash_table_.end()) {
-                return IncrementedObjectPtr::NULL_PTR;
-            }
+        std::lock_guard lk{mutex_};
+        store_slot(find_or_add_slot(key_obj), value);
+    }
+
+    /// @brief set_value() using inline cache of the call site.
+    void set_value(const void *key, const ValueType &value, LJFAttribute attr,
+                   InlineCache &cache) {
+        if (!cache.bind_key(key, attr)) {
+            cache.count_miss();
+            set_value(key, value, attr);
+            return;
+        }
 
-            auto obj = array_table_.at(it->second);
-            //  We have to increment returned object because:
-            //      returned object will released if other thread decrement
-            //      refcount
-            auto ret = obj.as_object();
-            increment_ref_count(ret);
-            return static_cast<IncrementedObjectPtr>(reinterpret_cast<uintptr_t>(ret));
+        std::lock_guard lk{mutex_};
+        size_t slot;
+        if (auto entry = cache.find(shape_)) {
+            cache.count_hit();
+            if (entry->new_shape != shape_) {
+                transit_shape(entry->new_shape);
+            }
+            slot = entry->slot;
+        } else {
+            cache.count_miss();
+            auto old_shape = shape_;
+            slot = find_or_add_slot(Key{attr, key});
+            if (!is_dictionary()) {
+                cache.add({old_shape, shape_, slot});
+            }
         }
+        store_slot(slot, value);
     }
 
     void set(const void *key, Object *value, LJFAttribute attr) {
+        set_value(key, ValueType{attr, value}, attr);
+    }
+
+    /// @brief set() using inline cache of the call site.
+    void set(const void *key, Object *value, LJFAttribute attr,
+             InlineCache &cache) {
+        set_value(key, ValueType{attr, value}, attr, cache);
+    }
 
+    /// @brief Get an unboxed value without allocation.
+    /// @return std::nullopt if this object doesn't have key.
+    /// If the value is boxed, throw ljf::runtime_error.
+    std::optional<ValueType> get_unboxed(const void *key, LJFAttribute attr) {
         Key key_obj{attr, key};
 
-        size_t index;
-        {
-            std::lock_guard lk{mutex_};
-            if (!hash_table_.count(key_obj)) {
-                index = array_table_new_index();
-                hash_table_[key_obj] = index;
-            } else {
-                index = hash_table_.at(key_obj);
-            }
-            ValueType v{attr, value};
-            increment_ref_count_if_object(v);
-            decrement_ref_count_if_object(array_table_[index]);
-            array_table_[index] = v;
-            ++version_;
+        std::lock_guard lk{mutex_};
+        auto slot = lookup_slot(key_obj);
+        if (!slot) {
+            return std::nullopt;
+        }
+        auto value = slots_[*slot];
+        if (value.is_object()) {
+            throw ljf::runtime_error("value is not unboxed");
+        }
+        return value;
+    }
+
+    static ValueKind kind_of(const ValueType &value) {
+        if (value.is_object()) {
+            return ValueKind::object;
         }
+        return value.is_int64() ? ValueKind::int64 : ValueKind::double_value;
     }
 
     static void increment_ref_count_if_object(const ValueType &value) {
@@ -229,39 +472,37 @@ public:
 
     FunctionId get_function_id(const std::string &key) {
         std::lock_guard lk{mutex_};
-        return function_id_table_.at(key);
+        if (!ext_) {
+            throw std::out_of_range("function id not found: " + key);
+        }
+        return ext_->function_id_table.at(key);
     }
     void set_function_id(const std::string &key, FunctionId function_id) {
-        function_id_table_.insert_or_assign(key, function_id);
+        std::lock_guard lk{mutex_};
+        ext().function_id_table.insert_or_assign(key, function_id);
     }
 
     // disable unsafe api
     // Object *&array_table_get_index(uint64_t index) {
-    //     return array_table_[index];
+    //     return slots_[index];
     // }
 
     // Object *&array_table_set_index(uint64_t index, Object *value) {
     //     increment_ref_count(value);
-    //     decrement_ref_count(array_table_[index]);
-    //     return array_table_[index] = value;
+    //     decrement_ref_count(slots_[index]);
+    //     return slots_[index] = value;
     // }
 
-    uint64_t array_table_new_index() {
-        uint64_t index = array_table_.size();
-        array_table_.push_back(ValueType{LJF_ATTR_DEFAULT,
-                                         // ljf_internal_nullptr means variable
-                                         // will be initialized in future.
-                                         cast_object_to_ObjectPtrOrNativeValue(
-                                             internal::ljf_internal_nullptr)});
-        return index;
-    }
-
     void array_table_reserve(uint64_t size) {
         throw ljf::runtime_error("unsupported operation");
-        // array_table_.reserve(size);
+        // reserve_slots(size);
     }
 
-    void array_table_resize(uint64_t size) { array_table_.resize(size); }
+    void array_table_resize(uint64_t size) {
+        std::lock_guard lk{mutex_};
+        // Slots are never shrunk, so slots used by shape_ are not removed.
+        reserve_slots(size);
+    }
 
     void lock() { mutex_.lock(); }
 
@@ -272,72 +513,256 @@ public:
     // array API
     size_t array_size() {
         std::lock_guard lk{mutex_};
-        return array_.size();
+        return ext_ ? ext_->array.size() : 0;
     }
-    ObjectHolder array_at(uint64_t index) {
+    /// @return element at index. If it is an object, it is incremented.
+    ValueType array_value_at(uint64_t index) {
         std::lock_guard lk{mutex_};
-        return ObjectHolder(array_.at(index));
+        if (!ext_) {
+            throw std::out_of_range("array index out of range");
+        }
+        auto value = ext_->array.at(index);
+        increment_ref_count_if_object(value);
+        return value;
     }
-    void array_set_at(uint64_t index, Object *value) {
-        Object *old_value;
+    /// @brief Get element at index as an object. Unboxed value is boxed.
+    ObjectHolder array_at(uint64_t index) {
+        ValueType value;
         {
             std::lock_guard lk{mutex_};
-            auto &elem_ref = array_.at(index);
+            if (!ext_) {
+                throw std::out_of_range("array index out of range");
+            }
+            value = ext_->array.at(index);
+            if (value.is_object()) {
+                return ObjectHolder(value.as_object());
+            }
+        }
+        // box() locks the new object, so we must not hold our lock.
+        return box(value);
+    }
+    void array_set_value_at(uint64_t index, const ValueType &value) {
+        ValueType old_value;
+        {
+            std::lock_guard lk{mutex_};
+            if (!ext_) {
+                throw std::out_of_range("array index out of range");
+            }
+            auto &elem_ref = ext_->array.at(index);
+            increment_ref_count_if_object(value);
             old_value = elem_ref;
             elem_ref = value;
+            type_ = type_->with_array_element(kind_of(value));
         }
+        decrement_ref_count_if_object(old_value);
+    }
+    void array_set_at(uint64_t index, Object *value) {
         assert(value); // DEBUG
-        increment_ref_count(value);
-        decrement_ref_count(old_value);
+        array_set_value_at(index, ValueType{LJF_ATTR_DEFAULT, value});
     }
 
+    void array_push_value(const ValueType &value) {
+        std::lock_guard lk{mutex_};
+        increment_ref_count_if_object(value);
+        ext().array.push_back(value);
+        type_ = type_->with_array_element(kind_of(value));
+        ++version_;
+    }
     void array_push(Object *value) {
-        {
-            std::lock_guard lk{mutex_};
-            array_.push_back(value);
-            ++version_;
-        }
         // assert(value); // DEBUG
-        increment_ref_count(value);
+        array_push_value(ValueType{LJF_ATTR_DEFAULT, value});
     }
 
-    // native data
-    uint64_t get_native_data() const { return native_data_; }
+    // environment API
+    // An environment is a frame of variables stored in slots of the object,
+    // and a link to the parent environment shared by its children.
 
-    std::shared_ptr<TypeObject> calculate_type() {
+    /// @brief Make this object an environment whose parent is parent.
+    /// @param parent environment or nullptr
+    void make_environment(Object *parent) {
         std::lock_guard lk{mutex_};
-        if (type_object_) {
-            return type_object_;
+        auto &ext = this->ext();
+        increment_ref_count(parent);
+        decrement_ref_count(ext.environment_parent);
+        ext.is_environment = true;
+        ext.environment_parent = parent;
+    }
+
+    bool is_environment() {
+        std::lock_guard lk{mutex_};
+        return ext_ && ext_->is_environment;
+    }
+
+    /// @return parent environment, which is alive while this object is alive.
+    Object *environment_parent() {
+        std::lock_guard lk{mutex_};
+        return ext_ ? ext_->environment_parent : nullptr;
+    }
+
+    /// @return slot index of key, or std::nullopt if this object doesn't have
+    /// key.
+    /// @param shape If given, set to the shape of this object, for which the
+    /// slot index is valid, or nullptr in dictionary mode.
+    std::optional<size_t> find_slot(const void *key, LJFAttribute attr,
+                                    const Shape **shape = nullptr) {
+        Key key_obj{attr, key};
+
+        std::lock_guard lk{mutex_};
+        if (shape) {
+            *shape = is_dictionary() ? nullptr : shape_;
+        }
+        return lookup_slot(key_obj);
+    }
+
+    /// @return value of slot. If it is an object, it is incremented.
+    ValueType get_value_at_slot(size_t slot) {
+        std::lock_guard lk{mutex_};
+        if (slot >= slot_count()) {
+            throw std::out_of_range("slot index out of range");
         }
+        return load_slot(slot);
+    }
 
-        type_object_ = ljf::calculate_type(*this);
-        return type_object_;
+    void set_value_at_slot(size_t slot, const ValueType &value) {
+        std::lock_guard lk{mutex_};
+        if (slot >= slot_count()) {
+            throw std::out_of_range("slot index out of range");
+        }
+        store_slot(slot, value);
+    }
+
+    /// @brief get_value_at_slot() for code specialized to shape.
+    /// @return std::nullopt if the shape of this object is not shape.
+    std::optional<ValueType> get_value_if_shape(const Shape *shape,
+                                                size_t slot) {
+        std::lock_guard lk{mutex_};
+        if (shape_ != shape) {
+            return std::nullopt;
+        }
+        return load_slot(slot);
     }
 
-    std::shared_ptr<TypeObject> calculate_type(TypeCalcData &type_calc_data) {
+    /// @brief get_unboxed() for code specialized to shape.
+    /// @return std::nullopt if the shape of this object is not shape.
+    std::optional<ValueType> get_unboxed_if_shape(const Shape *shape,
+                                                  size_t slot) {
         std::lock_guard lk{mutex_};
-        if (type_object_) {
-            return type_object_;
+        if (shape_ != shape) {
+            return std::nullopt;
+        }
+        auto value = slots_[slot];
+        if (value.is_object()) {
+            throw ljf::runtime_error("value is not unboxed");
         }
+        return value;
+    }
 
-        type_object_ = ljf::calculate_type(*this, type_calc_data);
-        return type_object_;
+    /// @brief set_value_at_slot() for code specialized to shape.
+    /// @return false if the shape of this object is not shape.
+    bool set_value_if_shape(const Shape *shape, size_t slot,
+                            const ValueType &value) {
+        std::lock_guard lk{mutex_};
+        if (shape_ != shape) {
+            return false;
+        }
+        store_slot(slot, value);
+        return true;
+    }
+
+    // native data
+    uint64_t get_native_data() const { return native_data_; }
+
+    const Shape *shape() {
+        std::lock_guard lk{mutex_};
+        return shape_;
+    }
+
+    /// @brief Get the type of this object in O(1).
+    const TypeObject *calculate_type() {
+        std::lock_guard lk{mutex_};
+        return type_;
     }
 
     ~Object() {
+        if constexpr (config::cycle_collection) {
+            unregister_object(this);
+        }
         // std::cout << "~Object() " << this << "\n";
         // std::cout << " dump\n";
         // dump();
 
-        for (auto &&obj : array_table_) {
-            decrement_ref_count_if_object(obj);
+        for (size_t i = 0; i < slot_capacity_; i++) {
+            decrement_ref_count_if_object(slots_[i]);
         }
+        delete[] slots_;
 
-        for (auto &&obj : array_) {
-            decrement_ref_count(obj);
+        if (ext_) {
+            for (auto &&value : ext_->array) {
+                decrement_ref_count_if_object(value);
+            }
+            decrement_ref_count(ext_->environment_parent);
+            for (auto &&key : ext_->dictionary_keys) {
+                if (key.is_object_key()) {
+                    decrement_ref_count(
+                        const_cast<Object *>(key.get_key_as_object()));
+                }
+            }
         }
     }
 
+    /// @brief Call f(Object *) for each object referred by this object.
+    /// @details Caller must hold lock.
+    template <typename Function> void foreach_reference(Function &&f) {
+        auto visit = [&f](const ValueType &value) {
+            if (value.is_object() && value.as_object()) {
+                f(value.as_object());
+            }
+        };
+        for (size_t i = 0; i < slot_capacity_; i++) {
+            visit(slots_[i]);
+        }
+        if (ext_) {
+            for (auto &&value : ext_->array) {
+                visit(value);
+            }
+            if (ext_->environment_parent) {
+                f(ext_->environment_parent);
+            }
+            for (auto &&key : ext_->dictionary_keys) {
+                if (key.is_object_key()) {
+                    f(const_cast<Object *>(key.get_key_as_object()));
+                }
+            }
+        }
+    }
+
+    /// @brief Remove all references of this object and move them to out.
+    /// @details Caller must hold lock, and must decrement objects moved to
+    /// out.
+    void take_references(std::vector<ValueType> &out) {
+        for (size_t i = 0; i < slot_capacity_; i++) {
+            out.push_back(slots_[i]);
+            slots_[i] = ValueType();
+        }
+        if (ext_) {
+            out.insert(out.end(), ext_->array.begin(), ext_->array.end());
+            ext_->array.clear();
+            out.emplace_back(LJF_ATTR_DEFAULT, ext_->environment_parent);
+            ext_->environment_parent = nullptr;
+            // Keys go with their slots, which are cleared above.
+            for (auto &&key : ext_->dictionary_keys) {
+                if (key.is_object_key()) {
+                    out.emplace_back(
+                        LJF_ATTR_DEFAULT,
+                        const_cast<Object *>(key.get_key_as_object()));
+                }
+            }
+            ext_->dictionary_keys.clear();
+            ext_->dictionary.clear();
+        }
+        ++version_;
+    }
+
     class TableIterator;
 
     class TableRange;
@@ -347,8 +772,17 @@ public:
 
     friend void increment_ref_count(Object *obj);
     friend void decrement_ref_count(Object *obj);
+    friend DeferredOwnership acquire_deferred_ownership(Object *obj,
+                                                        uint64_t context_seq);
+    friend void release_deferred_ownership(Object *obj, uint64_t context_seq);
+    friend class CycleCollector;
 };
 
+// lock, version and slot capacity, shape, type, slots, extension, native
+// data, refcount, deferred owner thread and seq, and registry position (8
+// each). Rarely used parts go to Object::Extension.
+static_assert(sizeof(Object) <= 88, "Object grew; move parts to Extension");
+
 inline void set_object_to_table(Object *obj, const char *key, Object *value) {
     obj->set(const_cast<char *>(key), value,
              AttributeTraits::or_attr(LJF_ATTR_VISIBLE, LJF_ATTR_C_STR_KEY));
@@ -14,10 +14,10 @@ public:
 class Object::TableIterator {
 private:
     ObjectHolder obj_;
-    size_t version_;
-    using I = std::unordered_map<Key, size_t>::iterator;
-    std::unordered_map<Key, size_t>::iterator map_iter_;
-    std::unordered_map<Key, size_t>::iterator map_iter_end_;
+    uint32_t version_;
+    // TableIterator iterates slots of obj_ in the order of insertion.
+    size_t slot_;
+    size_t slot_end_;
 
     /// - check object version
     /// - check iterator not ended
@@ -35,58 +35,61 @@ private:
 
 public:
     struct KeyValue {
+        // An object key is held by the iterated object, not by KeyValue.
         Key key;
         ObjectHolder value;
     };
 
     /// @brief Caller MUST lock obj.
     /// @param obj
-    /// @param iter
-    explicit TableIterator(ObjectHolder obj, I iter)
-        : obj_(obj), version_(obj->version_), map_iter_(iter) {
-        map_iter_end_ = obj->hash_table_.end();
+    /// @param slot
+    explicit TableIterator(ObjectHolder obj, size_t slot)
+        : obj_(obj), version_(obj->version_), slot_(slot) {
+        slot_end_ = obj->slot_count();
     }
 
     /// @brief return current pointing KeyValue and go next
     /// description This function has same semantics as *(iter++)
     /// @return current pointing KeyValue
     KeyValue next() {
-        std::lock_guard lk{*obj_};
-        check();
-
-        auto &key = map_iter_->first;
-        Object *value = obj_->array_table_.at(map_iter_->second).as_object();
-
-        ++map_iter_;
-        return KeyValue{key, value};
+        auto kv = **this;
+        ++slot_;
+        return kv;
     }
 
     TableIterator operator++() {
-        ++map_iter_;
+        ++slot_;
         return *this;
     }
 
     KeyValue operator*() {
-        std::lock_guard lk{*obj_};
-        check();
-
-        auto &key = map_iter_->first;
-        Object *value = obj_->array_table_.at(map_iter_->second).as_object();
-
-        return KeyValue{key, value};
+        Key key;
+        ValueType value;
+        {
+            std::lock_guard lk{*obj_};
+            check();
+
+            key = obj_->key_at(slot_);
+            value = obj_->slots_[slot_];
+            if (value.is_object()) {
+                return KeyValue{key, value.as_object()};
+            }
+        }
+        // box() locks the new object, so we must not hold the lock of obj_.
+        return KeyValue{key, box(value)};
     }
 
     bool operator==(const TableIterator &other) const {
         // Do not check (version_ == other.version_)
         // because iter == end will never true if version is changed.
-        return map_iter_ == other.map_iter_;
+        return slot_ == other.slot_;
     }
 
     bool operator!=(const TableIterator &other) const {
         return !(*this == other);
     }
 
-    bool is_end() const { return map_iter_ == map_iter_end_; }
+    bool is_end() const { return slot_ == slot_end_; }
 
     explicit operator bool() const { return !is_end(); }
 };
@@ -105,22 +108,21 @@ public:
 
 inline Object::TableRange Object::iter_hash_table() {
     std::lock_guard lk{*this};
-    return TableRange(
-        TableIterator(this, this->hash_table_.begin()),
-        TableIterator(this, this->hash_table_.end()));
+    return TableRange(TableIterator(this, 0),
+                      TableIterator(this, this->slot_count()));
 }
 
 class Object::ArrayIterator {
 private:
-    size_t version_;
+    uint32_t version_;
     ObjectHolder obj_;
-    std::vector<Object *>::iterator array_iter_;
-    std::vector<Object *>::iterator array_iter_end_;
+    std::vector<ValueType>::iterator array_iter_;
+    std::vector<ValueType>::iterator array_iter_end_;
 
     /// Caller must hold lock of obj.
     explicit ArrayIterator(
-        ObjectHolder obj, const std::vector<Object *>::iterator &map_iter,
-        const std::vector<Object *>::iterator &array_iter_end)
+        ObjectHolder obj, const std::vector<ValueType>::iterator &map_iter,
+        const std::vector<ValueType>::iterator &array_iter_end)
         : obj_(obj) {
         version_ = obj->version_;
         array_iter_ = map_iter;
@@ -146,15 +148,24 @@ public:
         std::lock_guard lk{*obj_};
         version_ = obj->version_;
 
-        array_iter_ = obj_->array_.begin();
-        array_iter_end_ = obj_->array_.end();
+        auto &array = obj_->ext().array;
+        array_iter_ = array.begin();
+        array_iter_end_ = array.end();
     }
 
     ObjectHolder get() const {
-        std::lock_guard lk{*obj_};
-        check();
-
-        return *array_iter_;
+        ValueType value;
+        {
+            std::lock_guard lk{*obj_};
+            check();
+
+            value = *array_iter_;
+            if (value.is_object()) {
+                return value.as_object();
+            }
+        }
+        // box() locks the new object, so we must not hold the lock of obj_.
+        return box(value);
     }
 
     ArrayIterator next() const {
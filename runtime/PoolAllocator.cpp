@@ -0,0 +1,257 @@
+#include "PoolAllocator.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <ostream>
+
+namespace ljf {
+
+namespace {
+    constexpr size_t chunk_size = 64 * 1024;
+    constexpr size_t size_class_granularity = 16;
+    constexpr size_t size_class_num = pool_max_size / size_class_granularity;
+    // live bytes of a thread are flushed to global statistics when
+    // the difference exceeds this.
+    constexpr int64_t statistics_flush_threshold = 64 * 1024;
+
+    constexpr size_t size_class_of(size_t size) {
+        return (std::max<size_t>(size, 1) + size_class_granularity - 1) /
+                   size_class_granularity -
+               1;
+    }
+
+    constexpr size_t block_size_of(size_t size_class) {
+        return (size_class + 1) * size_class_granularity;
+    }
+
+    std::atomic<int64_t> live_bytes{0};
+    std::atomic<int64_t> peak_live_bytes{0};
+    std::atomic<size_t> reserved_bytes{0};
+
+    struct FreeBlock {
+        FreeBlock *next;
+    };
+
+    class ThreadCache;
+
+    /// Placed on the head of each chunk. Blocks in a chunk have same size.
+    struct alignas(64) ChunkHeader {
+        ThreadCache *owner;
+        size_t size_class;
+    };
+
+    ChunkHeader *chunk_of(void *ptr) {
+        return reinterpret_cast<ChunkHeader *>(reinterpret_cast<uintptr_t>(ptr) &
+                                               ~(chunk_size - 1));
+    }
+
+    /// Free lists of a thread.
+    /// ThreadCache is never destructed. When the thread exits, the cache is
+    /// adopted by a thread created later, so blocks freed by other threads can
+    /// be always returned to the owner of their chunk.
+    class ThreadCache {
+    private:
+        FreeBlock *free_lists_[size_class_num] = {};
+        char *bump_[size_class_num] = {};
+        char *bump_end_[size_class_num] = {};
+        // blocks freed by other threads
+        std::atomic<FreeBlock *> remote_free_list_{nullptr};
+        int64_t live_bytes_delta_ = 0;
+
+    public:
+        ThreadCache *next_orphan = nullptr;
+
+        void *allocate(size_t size_class) {
+            auto &free_list = free_lists_[size_class];
+            if (!free_list) {
+                drain_remote_free_list();
+            }
+            count_live_bytes(block_size_of(size_class));
+            if (free_list) {
+                auto block = free_list;
+                free_list = block->next;
+                return block;
+            }
+            return bump_allocate(size_class);
+        }
+
+        /// ptr must be in a chunk owned by this cache.
+        void deallocate_local(void *ptr, size_t size_class) {
+            auto block = static_cast<FreeBlock *>(ptr);
+            block->next = free_lists_[size_class];
+            free_lists_[size_class] = block;
+        }
+
+        /// Called by any thread.
+        void deallocate_remote(void *ptr) {
+            auto block = static_cast<FreeBlock *>(ptr);
+            block->next = remote_free_list_.load(std::memory_order_relaxed);
+            while (!remote_free_list_.compare_exchange_weak(
+                block->next, block, std::memory_order_release,
+                std::memory_order_relaxed)) {
+            }
+        }
+
+        void count_live_bytes(int64_t diff) {
+            live_bytes_delta_ += diff;
+            if (live_bytes_delta_ > statistics_flush_threshold ||
+                live_bytes_delta_ < -statistics_flush_threshold) {
+                flush_statistics();
+            }
+        }
+
+        void flush_statistics() {
+            auto live = live_bytes.fetch_add(live_bytes_delta_,
+                                             std::memory_order_relaxed) +
+                        live_bytes_delta_;
+            live_bytes_delta_ = 0;
+            auto peak = peak_live_bytes.load(std::memory_order_relaxed);
+            while (peak < live && !peak_live_bytes.compare_exchange_weak(
+                                      peak, live, std::memory_order_relaxed)) {
+            }
+        }
+
+    private:
+        void drain_remote_free_list() {
+            auto block = remote_free_list_.exchange(nullptr,
+                                                    std::memory_order_acquire);
+            while (block) {
+                auto next = block->next;
+                deallocate_local(block, chunk_of(block)->size_class);
+                block = next;
+            }
+        }
+
+        void *bump_allocate(size_t size_class) {
+            auto block_size = block_size_of(size_class);
+            auto &bump = bump_[size_class];
+            if (!bump || bump + block_size > bump_end_[size_class]) {
+                auto chunk = std::aligned_alloc(chunk_size, chunk_size);
+                if (!chunk) {
+                    throw std::bad_alloc();
+                }
+                reserved_bytes.fetch_add(chunk_size, std::memory_order_relaxed);
+                new (chunk) ChunkHeader{this, size_class};
+                bump = static_cast<char *>(chunk) + sizeof(ChunkHeader);
+                bump_end_[size_class] = static_cast<char *>(chunk) + chunk_size;
+            }
+            auto block = bump;
+            bump += block_size;
+            return block;
+        }
+    };
+
+    std::mutex orphans_mutex;
+    ThreadCache *orphans = nullptr;
+
+    // used by threads whose thread local cache is already released.
+    std::mutex shared_cache_mutex;
+    ThreadCache shared_cache;
+
+    ThreadCache *adopt_or_create_cache() {
+        std::lock_guard lk{orphans_mutex};
+        if (!orphans) {
+            return new ThreadCache;
+        }
+        auto cache = orphans;
+        orphans = cache->next_orphan;
+        cache->next_orphan = nullptr;
+        return cache;
+    }
+
+    thread_local ThreadCache *thread_cache = nullptr;
+    thread_local bool thread_exiting = false;
+
+    struct ThreadCacheReleaser {
+        ~ThreadCacheReleaser() {
+            thread_exiting = true;
+            if (!thread_cache) {
+                return;
+            }
+            thread_cache->flush_statistics();
+            std::lock_guard lk{orphans_mutex};
+            thread_cache->next_orphan = orphans;
+            orphans = thread_cache;
+            thread_cache = nullptr;
+        }
+    };
+    thread_local ThreadCacheReleaser thread_cache_releaser;
+
+    /// @return nullptr if the thread is exiting.
+    ThreadCache *current_cache() {
+        if (thread_cache) {
+            return thread_cache;
+        }
+        if (thread_exiting) {
+            return nullptr;
+        }
+        // register destructor of the releaser for this thread.
+        (void)&thread_cache_releaser;
+        thread_cache = adopt_or_create_cache();
+        return thread_cache;
+    }
+} // namespace
+
+void *pool_allocate(size_t size) {
+    if (size > pool_max_size) {
+        return ::operator new(size);
+    }
+
+    auto size_class = size_class_of(size);
+    if (auto cache = current_cache()) {
+        return cache->allocate(size_class);
+    }
+    std::lock_guard lk{shared_cache_mutex};
+    return shared_cache.allocate(size_class);
+}
+
+void pool_deallocate(void *ptr, size_t size) noexcept {
+    if (!ptr) {
+        return;
+    }
+    if (size > pool_max_size) {
+        ::operator delete(ptr);
+        return;
+    }
+
+    auto size_class = size_class_of(size);
+    auto chunk = chunk_of(ptr);
+    assert(chunk->size_class == size_class);
+    auto cache = current_cache();
+    if (cache) {
+        cache->count_live_bytes(-int64_t(block_size_of(size_class)));
+    } else {
+        std::lock_guard lk{shared_cache_mutex};
+        shared_cache.count_live_bytes(-int64_t(block_size_of(size_class)));
+    }
+
+    if (cache && chunk->owner == cache) {
+        cache->deallocate_local(ptr, size_class);
+    } else {
+        chunk->owner->deallocate_remote(ptr);
+    }
+}
+
+PoolStatistics pool_statistics() {
+    if (auto cache = current_cache()) {
+        cache->flush_statistics();
+    }
+    return PoolStatistics{
+        live_bytes.load(std::memory_order_relaxed),
+        peak_live_bytes.load(std::memory_order_relaxed),
+        reserved_bytes.load(std::memory_order_relaxed),
+    };
+}
+
+void dump_pool_statistics(std::ostream &out) {
+    auto stats = pool_statistics();
+    out << "LJF: pool allocator: live: " << stats.live_bytes
+        << " bytes, peak: " << stats.peak_live_bytes
+        << " bytes, reserved: " << stats.reserved_bytes << " bytes\n";
+}
+
+} // namespace ljf
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+
+namespace ljf {
+
+/// @brief Statistics of pool allocator.
+/// @details live_bytes and peak_live_bytes are updated in batches per thread,
+/// so they may miss recent allocations of other threads.
+struct PoolStatistics {
+    int64_t live_bytes;
+    int64_t peak_live_bytes;
+    /// memory taken from the system
+    size_t reserved_bytes;
+};
+
+/// @brief Allocate memory from the size class pool of the current thread.
+/// @details Sizes larger than pool_max_size are allocated by ::operator new.
+void *pool_allocate(size_t size);
+
+/// @brief Free memory allocated by pool_allocate().
+/// @details size must be the one given to pool_allocate().
+/// Memory may be freed by a thread other than the allocating thread,
+/// then it is returned to the allocating thread.
+void pool_deallocate(void *ptr, size_t size) noexcept;
+
+PoolStatistics pool_statistics();
+
+void dump_pool_statistics(std::ostream &out);
+
+constexpr size_t pool_max_size = 512;
+
+} // namespace ljf
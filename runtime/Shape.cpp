@@ -0,0 +1,82 @@
+#include "Shape.hpp"
+
+#include <stdexcept>
+
+namespace ljf {
+
+Shape::Shape(const Shape *parent, const Key &key)
+    : parent_(parent), key_(key), size_(parent->size_ + 1) {}
+
+Shape::~Shape() { delete table_.load(std::memory_order_relaxed); }
+
+const Shape *Shape::root() {
+    static const Shape root_shape;
+    return &root_shape;
+}
+
+const Shape *Shape::dictionary() {
+    static const Shape dictionary_shape;
+    return &dictionary_shape;
+}
+
+const Shape::Table &Shape::table() const {
+    if (auto table = table_.load(std::memory_order_acquire)) {
+        return *table;
+    }
+
+    auto table = std::make_unique<Table>();
+    table->keys.resize(size_);
+    for (auto shape = this; shape->size_ != 0; shape = shape->parent_) {
+        table->keys[shape->size_ - 1] = shape->key_;
+    }
+    table->slots.reserve(size_);
+    for (size_t slot = 0; slot < size_; slot++) {
+        table->slots.emplace(table->keys[slot], slot);
+    }
+
+    // Other thread may build the same table meanwhile.
+    const Table *expected = nullptr;
+    if (table_.compare_exchange_strong(expected, table.get(),
+                                       std::memory_order_acq_rel)) {
+        return *table.release();
+    }
+    return *expected;
+}
+
+const Key &Shape::key_at(size_t slot) const {
+    if (slot >= size_) {
+        throw std::out_of_range("slot index out of range");
+    }
+    if (size_ > linear_search_size) {
+        return table().keys[slot];
+    }
+    auto shape = this;
+    while (shape->size_ - 1 != slot) {
+        shape = shape->parent_;
+    }
+    return shape->key_;
+}
+
+const Shape *Shape::add_key(const Key &key) const {
+    assert(!is_dictionary());
+    assert(!key.is_c_str_key());
+    assert(!find_slot(key));
+    if (key.is_object_key()) {
+        // Shapes live forever, so they would keep the key object alive.
+        return nullptr;
+    }
+
+    std::lock_guard lk{transitions_mutex_};
+    auto it = transitions_.find(key);
+    if (it != transitions_.end()) {
+        return it->second.get();
+    }
+    if (size_ >= max_keys || transitions_.size() >= max_transitions) {
+        return nullptr;
+    }
+    auto child = new Shape(this, key);
+    transitions_.emplace(key, std::unique_ptr<Shape>(child));
+    return child;
+}
+
+} // namespace ljf
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "Key.hpp"
+
+namespace ljf {
+
+/// @brief Shape (hidden class) of an Object.
+/// @details Objects which have the same key insertion sequence share one
+/// Shape. A Shape maps keys to slot indices of Object::slots_ and never
+/// changes after creation except its caches, so a pair of (shape, slot index)
+/// found once can be reused for all objects of the shape.
+/// Shapes form a tree rooted at Shape::root() and live until the process
+/// exits. A Shape holds only the key added to its parent, and a lookup table
+/// of all keys is built on first use by large shapes.
+///
+/// Shapes don't hold object keys, and the number of keys and transitions
+/// of a shape is limited. Objects beyond them switch to dictionary mode,
+/// where the object has its own table and the shape is Shape::dictionary().
+class Shape {
+private:
+    const Shape *parent_ = nullptr;
+    // the key added to parent_, placed on slot index size() - 1
+    Key key_{};
+    size_t size_ = 0;
+
+    struct Table {
+        // key -> slot index
+        std::unordered_map<Key, size_t> slots;
+        // slot index -> key
+        std::vector<Key> keys;
+    };
+    // built by table()
+    mutable std::atomic<const Table *> table_{nullptr};
+
+    mutable std::mutex transitions_mutex_;
+    mutable std::unordered_map<Key, std::unique_ptr<Shape>> transitions_;
+
+    Shape() = default;
+    Shape(const Shape *parent, const Key &key);
+
+    const Table &table() const;
+
+public:
+    /// max number of keys of a shape
+    static constexpr size_t max_keys = 128;
+    /// max number of shapes made by add_key() of a shape
+    static constexpr size_t max_transitions = 64;
+    /// Shapes up to this size are searched by following parents instead of
+    /// building a table.
+    static constexpr size_t linear_search_size = 8;
+
+    Shape(const Shape &) = delete;
+    Shape(Shape &&) = delete;
+    Shape &operator=(const Shape &) = delete;
+    Shape &operator=(Shape &&) = delete;
+    ~Shape();
+
+    /// @brief The shape of objects which have no keys.
+    static const Shape *root();
+
+    /// @brief The shape of objects in dictionary mode, which has no keys.
+    static const Shape *dictionary();
+
+    bool is_dictionary() const noexcept { return this == dictionary(); }
+
+    /// @return slot index of key, or std::nullopt if this shape doesn't have
+    /// the key.
+    std::optional<size_t> find_slot(const Key &key) const {
+        if (size_ <= linear_search_size) {
+            for (auto shape = this; shape->size_ != 0;
+                 shape = shape->parent_) {
+                if (shape->key_ == key) {
+                    return shape->size_ - 1;
+                }
+            }
+            return std::nullopt;
+        }
+        auto &slots = table().slots;
+        auto it = slots.find(key);
+        if (it == slots.end()) {
+            return std::nullopt;
+        }
+        return it->second;
+    }
+
+    /// @brief Get the shape that has all keys of this shape and key.
+    /// key is placed on slot index size().
+    /// The returned shape is cached, so same transition returns same shape.
+    /// @return nullptr if the object must switch to dictionary mode instead:
+    /// key is an object key, or this shape reached max_keys or
+    /// max_transitions.
+    const Shape *add_key(const Key &key) const;
+
+    const Shape *parent() const noexcept { return parent_; }
+
+    /// @brief number of keys (slots)
+    size_t size() const noexcept { return size_; }
+
+    const Key &key_at(size_t slot) const;
+};
+
+} // namespace ljf
@@ -0,0 +1,35 @@
+#include "Symbol.hpp"
+
+#include <mutex>
+
+namespace ljf {
+
+const Symbol *SymbolTable::intern(std::string_view name) {
+    {
+        std::shared_lock lk{mutex_};
+        auto it = symbols_.find(name);
+        if (it != symbols_.end()) {
+            return it->second.get();
+        }
+    }
+
+    std::lock_guard lk{mutex_};
+    // other thread may intern name while we don't hold lock
+    auto it = symbols_.find(name);
+    if (it != symbols_.end()) {
+        return it->second.get();
+    }
+    auto symbol = std::make_unique<Symbol>(name, symbols_.size());
+    auto symbol_ptr = symbol.get();
+    symbols_.emplace(symbol_ptr->name(), std::move(symbol));
+    return symbol_ptr;
+}
+
+SymbolTable &SymbolTable::global() {
+    // Never destructed because symbols are referred by shapes until the
+    // process exits.
+    static auto table = new SymbolTable;
+    return *table;
+}
+
+} // namespace ljf
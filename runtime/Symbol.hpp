@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace ljf {
+
+/// @brief Interned string.
+/// @details There is at most one Symbol for each string, so symbols are
+/// compared and hashed by address. Symbols are never freed.
+class Symbol {
+private:
+    std::string name_;
+    uint64_t id_;
+    std::size_t hash_;
+
+public:
+    Symbol(std::string_view name, uint64_t id)
+        : name_(name), id_(id), hash_(hash(name)) {}
+    Symbol(const Symbol &) = delete;
+    Symbol &operator=(const Symbol &) = delete;
+
+    const char *c_str() const noexcept { return name_.c_str(); }
+    std::string_view name() const noexcept { return name_; }
+
+    /// @brief Unique and dense id of this symbol.
+    uint64_t id() const noexcept { return id_; }
+
+    /// @brief hash(name()), computed once.
+    std::size_t hash() const noexcept { return hash_; }
+
+    /// @brief Hash of a string, same as the hash of its Symbol.
+    static std::size_t hash(std::string_view name) noexcept {
+        return std::hash<std::string_view>()(name);
+    }
+
+    /// @brief Get the unique Symbol of name.
+    static const Symbol *intern(std::string_view name);
+};
+
+class SymbolTable {
+private:
+    std::shared_mutex mutex_;
+    // keys are views of Symbol::name_
+    std::unordered_map<std::string_view, std::unique_ptr<Symbol>> symbols_;
+
+public:
+    const Symbol *intern(std::string_view name);
+
+    /// @brief number of interned symbols
+    std::size_t size() {
+        std::shared_lock lk{mutex_};
+        return symbols_.size();
+    }
+
+    static SymbolTable &global();
+};
+
+inline const Symbol *Symbol::intern(std::string_view name) {
+    return SymbolTable::global().intern(name);
+}
+
+} // namespace ljf
@@ -0,0 +1,56 @@
+#include "ThinLock.hpp"
+
+#include <thread>
+
+namespace ljf {
+
+void ThinLock::lock_slow() {
+    for (;;) {
+        auto word = word_.load(std::memory_order_acquire);
+
+        if (is_inflated_word(word)) {
+            monitor_of(word)->mutex.lock();
+            return;
+        }
+
+        if (word != 0) {
+            // Other thread holds thin lock. Wait for the owner to release.
+            std::this_thread::yield();
+            continue;
+        }
+
+        // This lock was contended, so inflate it while taking it.
+        auto monitor = new Monitor;
+        monitor->mutex.lock();
+        auto inflated = reinterpret_cast<uintptr_t>(monitor) | inflated_bit;
+        uintptr_t expected = 0;
+        if (word_.compare_exchange_strong(expected, inflated,
+                                          std::memory_order_acq_rel)) {
+            return;
+        }
+        monitor->mutex.unlock();
+        delete monitor;
+        // expected is thin lock of other thread or inflated lock.
+    }
+}
+
+void ThinLock::inflate_locked(uintptr_t word) {
+    // Take the mutex as many times as the thin lock including this lock.
+    auto monitor = new Monitor;
+    auto depth = (word & recursion_mask) / recursion_one + 2;
+    for (uintptr_t i = 0; i < depth; i++) {
+        monitor->mutex.lock();
+    }
+    // Other threads only wait while the word is thin locked.
+    word_.store(reinterpret_cast<uintptr_t>(monitor) | inflated_bit,
+                std::memory_order_release);
+}
+
+ThinLock::~ThinLock() {
+    auto word = word_.load(std::memory_order_relaxed);
+    if (is_inflated_word(word)) {
+        delete monitor_of(word);
+    }
+}
+
+} // namespace ljf
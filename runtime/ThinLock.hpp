@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <mutex>
+
+#include "ThreadToken.hpp"
+
+namespace ljf {
+
+/// @brief Recursive lock which is a word while it is not contended.
+/// @details Lock word is one of:
+///     - 0: unlocked
+///     - (thread token | recursion << 1): locked by the thread
+///     - (Monitor * | 1): inflated, all threads use Monitor::mutex
+///
+/// An uncontended lock/unlock is a CAS and a store on the word. A thread
+/// which waited for a thin lock inflates it when it acquires, so threads
+/// contending later sleep on a std::recursive_mutex instead of spinning.
+/// The owner inflates the lock when recursion doesn't fit in the word.
+/// Inflated locks are never deflated.
+/// ThinLock satisfies Lockable, so it can be used with std::lock_guard and
+/// std::scoped_lock.
+class ThinLock {
+private:
+    struct Monitor {
+        std::recursive_mutex mutex;
+    };
+
+    static constexpr uintptr_t inflated_bit = 1;
+    // Recursion depth of thin lock is in the low bits of thread token.
+    static constexpr uintptr_t recursion_one = 2;
+    static constexpr uintptr_t recursion_mask =
+        thread_token_low_mask & ~inflated_bit;
+
+    std::atomic<uintptr_t> word_{0};
+
+    static bool is_inflated_word(uintptr_t word) noexcept {
+        return word & inflated_bit;
+    }
+
+    static bool is_thin_locked_by(uintptr_t word, uintptr_t self) noexcept {
+        return !is_inflated_word(word) && (word & ~recursion_mask) == self;
+    }
+
+    /// @brief Lock once more while this thread holds the thin lock of word.
+    void lock_recursively(uintptr_t word) {
+        if ((word & recursion_mask) == recursion_mask) {
+            inflate_locked(word);
+            return;
+        }
+        // Only the owner writes the word until it is unlocked.
+        word_.store(word + recursion_one, std::memory_order_relaxed);
+    }
+
+    void lock_slow();
+    void inflate_locked(uintptr_t word);
+
+    static Monitor *monitor_of(uintptr_t word) noexcept {
+        assert(is_inflated_word(word));
+        return reinterpret_cast<Monitor *>(word & ~inflated_bit);
+    }
+
+public:
+    ThinLock() = default;
+    ThinLock(const ThinLock &) = delete;
+    ThinLock &operator=(const ThinLock &) = delete;
+    ~ThinLock();
+
+    void lock() {
+        auto self = current_thread_token();
+        uintptr_t expected = 0;
+        if (word_.compare_exchange_strong(expected, self,
+                                          std::memory_order_acquire)) {
+            return;
+        }
+        if (is_thin_locked_by(expected, self)) {
+            lock_recursively(expected);
+            return;
+        }
+        lock_slow();
+    }
+
+    bool try_lock() {
+        auto self = current_thread_token();
+        uintptr_t expected = 0;
+        if (word_.compare_exchange_strong(expected, self,
+                                          std::memory_order_acquire)) {
+            return true;
+        }
+        if (is_thin_locked_by(expected, self)) {
+            lock_recursively(expected);
+            return true;
+        }
+        if (is_inflated_word(expected)) {
+            return monitor_of(expected)->mutex.try_lock();
+        }
+        return false;
+    }
+
+    void unlock() {
+        auto word = word_.load(std::memory_order_relaxed);
+        if (is_inflated_word(word)) {
+            monitor_of(word)->mutex.unlock();
+            return;
+        }
+        assert(is_thin_locked_by(word, current_thread_token()));
+        if (word & recursion_mask) {
+            word_.store(word - recursion_one, std::memory_order_relaxed);
+            return;
+        }
+        word_.store(0, std::memory_order_release);
+    }
+
+    /// @brief Whether this lock has been contended and uses a real mutex.
+    bool is_inflated() const noexcept {
+        return is_inflated_word(word_.load(std::memory_order_acquire));
+    }
+};
+
+} // namespace ljf
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+
+namespace ljf {
+
+/// @brief Low bits which are zero in every thread token.
+constexpr uintptr_t thread_token_low_mask = 63;
+
+/// @brief Non zero multiple of 64 unique among living threads.
+inline uintptr_t current_thread_token() noexcept {
+    // address of thread local variable is unique among living threads.
+    alignas(thread_token_low_mask + 1) static thread_local char token;
+    return reinterpret_cast<uintptr_t>(&token);
+}
+
+} // namespace ljf
@@ -0,0 +1,159 @@
+#include "TypeObject.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <mutex>
+#include <unordered_set>
+
+namespace ljf {
+
+struct TypeObjectHash {
+    std::size_t operator()(const TypeObject *type) const {
+        return type->hash_;
+    }
+};
+
+struct TypeObjectEqualTo {
+    bool operator()(const TypeObject *type1, const TypeObject *type2) const {
+        return type1->shape_ == type2->shape_ &&
+               type1->array_kind_ == type2->array_kind_ &&
+               type1->slot_kinds_ == type2->slot_kinds_;
+    }
+};
+
+/// @brief Set of all TypeObjects.
+/// @details The set is split into shards by structural hash so that threads
+/// interning different types rarely wait for each other.
+class TypeTable {
+private:
+    static constexpr std::size_t shard_count = 16;
+
+    struct Shard {
+        std::shared_mutex mutex;
+        // TypeObjects are never deleted.
+        std::unordered_set<const TypeObject *, TypeObjectHash,
+                           TypeObjectEqualTo>
+            set;
+    };
+    Shard shards_[shard_count];
+    std::atomic<uint64_t> next_id_ = 0;
+
+    std::mutex type_counts_mutex_;
+    // shape -> number of types of the shape
+    std::unordered_map<const Shape *, std::size_t> type_counts_;
+
+    /// @return false if the shape already has max_types_per_shape types.
+    bool reserve_type_of(const Shape *shape) {
+        std::lock_guard lk{type_counts_mutex_};
+        auto &count = type_counts_[shape];
+        if (count == TypeObject::max_types_per_shape) {
+            return false;
+        }
+        ++count;
+        return true;
+    }
+
+public:
+    /// @param limited If true and type is new, it is interned only if its
+    /// shape has less than max_types_per_shape types.
+    /// @return the canonical type, or nullptr if limited
+    const TypeObject *intern(std::unique_ptr<TypeObject> type, bool limited) {
+        auto &shard = shards_[type->hash_ % shard_count];
+        {
+            std::shared_lock lk{shard.mutex};
+            auto it = shard.set.find(type.get());
+            if (it != shard.set.end()) {
+                return *it;
+            }
+        }
+
+        std::lock_guard lk{shard.mutex};
+        auto it = shard.set.find(type.get());
+        if (it != shard.set.end()) {
+            return *it;
+        }
+        if (limited && !reserve_type_of(type->shape_)) {
+            return nullptr;
+        }
+        type->id_ = next_id_.fetch_add(1, std::memory_order_relaxed);
+        shard.set.insert(type.get());
+        return type.release();
+    }
+
+    static TypeTable &global() {
+        static auto table = new TypeTable;
+        return *table;
+    }
+};
+
+TypeObject::TypeObject(const Shape *shape, std::vector<ValueKind> slot_kinds,
+                       ValueKind array_kind)
+    : shape_(shape), slot_kinds_(std::move(slot_kinds)),
+      array_kind_(array_kind) {
+    assert(slot_kinds_.size() == shape_->size());
+
+    std::size_t hash = std::hash<const void *>()(shape_);
+    for (auto kind : slot_kinds_) {
+        hash = hash * 31 + static_cast<std::size_t>(kind);
+    }
+    hash_ = hash * 31 + static_cast<std::size_t>(array_kind_);
+}
+
+const TypeObject *TypeObject::root() {
+    static const TypeObject *root_type = intern(std::unique_ptr<TypeObject>(
+        new TypeObject(Shape::root(), {}, ValueKind::none)));
+    return root_type;
+}
+
+const TypeObject *TypeObject::intern(std::unique_ptr<TypeObject> type) {
+    return TypeTable::global().intern(std::move(type), false);
+}
+
+const TypeObject *TypeObject::intern_limited(const Shape *shape,
+                                             std::vector<ValueKind> slot_kinds,
+                                             ValueKind array_kind) {
+    auto type = TypeTable::global().intern(
+        std::unique_ptr<TypeObject>(
+            new TypeObject(shape, std::move(slot_kinds), array_kind)),
+        true);
+    if (type) {
+        return type;
+    }
+    // The generic type of the shape, which isn't counted.
+    return intern(std::unique_ptr<TypeObject>(new TypeObject(
+        shape,
+        std::vector<ValueKind>(shape->is_dictionary() ? 0 : shape->size(),
+                               ValueKind::mixed),
+        array_kind)));
+}
+
+const TypeObject *TypeObject::transit(const Transition &transition) const {
+    {
+        std::shared_lock lk{transitions_mutex_};
+        auto it = transitions_.find(transition);
+        if (it != transitions_.end()) {
+            return it->second;
+        }
+    }
+
+    auto slot_kinds = slot_kinds_;
+    auto array_kind = array_kind_;
+    if (transition.slot == array_transition) {
+        array_kind = join(array_kind, transition.kind);
+    } else if (transition.shape->is_dictionary()) {
+        slot_kinds.clear();
+    } else {
+        assert(transition.slot < transition.shape->size());
+        slot_kinds.resize(transition.shape->size(), ValueKind::none);
+        slot_kinds[transition.slot] = transition.kind;
+    }
+    // The result may be reached by other transitions, so it is interned.
+    auto type =
+        intern_limited(transition.shape, std::move(slot_kinds), array_kind);
+
+    std::lock_guard lk{transitions_mutex_};
+    transitions_.emplace(transition, type);
+    return type;
+}
+
+} // namespace ljf
@@ -1,131 +1,151 @@
-#include "gtest/gtest.h"
-#include <gtest/gtest_prod.h>
+#pragma once
+
+#include <cstdint>
 #include <memory>
+#include <shared_mutex>
 #include <unordered_map>
-#include <unordered_set>
 #include <vector>
 
-#include "Object.hpp"
-#include "ObjectIterator.hpp"
+#include "Shape.hpp"
 
-template <> struct std::hash<ljf::TypeObject>;
 namespace ljf {
+
+/// @brief Kind of a value stored in a slot or an array element.
+enum class ValueKind : uint8_t {
+    /// no value stored yet
+    none,
+    object,
+    int64,
+    double_value,
+    /// values of different kinds (array elements, or slots of the generic
+    /// type of a shape)
+    mixed,
+};
+
+/// @brief Type (structure) of an Object.
+/// @details A TypeObject is the shape of an object, the kind of the value of
+/// each slot, and the kind of all array elements. Types of referenced objects
+/// are not included, so the type of an object depends only on the object
+/// itself. Objects update their type on every store by a transition cached in
+/// the TypeObject, so getting the type of an object is O(1).
+///
+/// TypeObjects are hash-consed: structurally equal types are the same
+/// TypeObject, so types are compared by pointer or id(). TypeObjects live
+/// until the process exits, so a shape has at most max_types_per_shape
+/// types. Objects of the shape beyond them get the generic type of the
+/// shape, whose slots are all ValueKind::mixed.
 class TypeObject {
 private:
-    bool circular_reference_ = false;
-    std::unordered_map<std::string, std::shared_ptr<TypeObject>>
-        hash_table_types_;
-    std::vector<std::shared_ptr<TypeObject>> array_types_;
+    const Shape *shape_;
+    // slot index -> kind, same size as shape_
+    std::vector<ValueKind> slot_kinds_;
+    // join of kinds of all elements pushed or set to the array. It is not
+    // narrowed when an element is overwritten.
+    ValueKind array_kind_;
+    // structural hash, used to intern
+    std::size_t hash_;
+    // given when interned
+    uint64_t id_ = 0;
+
+    struct Transition {
+        const Shape *shape;
+        // slot index, or array_transition
+        std::size_t slot;
+        ValueKind kind;
+
+        bool operator==(const Transition &other) const {
+            return shape == other.shape && slot == other.slot &&
+                   kind == other.kind;
+        }
+    };
+    struct TransitionHash {
+        std::size_t operator()(const Transition &t) const {
+            return std::hash<const void *>()(t.shape) ^
+                   std::hash<std::size_t>()(t.slot * 8 +
+                                            static_cast<std::size_t>(t.kind));
+        }
+    };
+    static constexpr std::size_t array_transition = SIZE_MAX;
 
-private:
-    friend std::shared_ptr<TypeObject> calculate_type(Object &obj);
-    friend std::shared_ptr<TypeObject> calculate_type(Object &obj,
-                                                      TypeCalcData &);
-    FRIEND_TEST(calculate_type, TestCircularReference);
+    mutable std::shared_mutex transitions_mutex_;
+    mutable std::unordered_map<Transition, const TypeObject *, TransitionHash>
+        transitions_;
 
-    explicit TypeObject(bool circular_reference)
-        : circular_reference_(circular_reference) {}
+    TypeObject(const Shape *shape, std::vector<ValueKind> slot_kinds,
+               ValueKind array_kind);
 
-    static std::shared_ptr<TypeObject> create_circular_reference_type_object() {
-        return std::make_shared<TypeObject>(TypeObject(true));
-    }
+    /// @brief Get the canonical TypeObject equal to type.
+    static const TypeObject *intern(std::unique_ptr<TypeObject> type);
 
-public:
-    TypeObject() = default;
+    /// @brief Get the canonical type, or the generic type of shape if shape
+    /// has max_types_per_shape types already.
+    static const TypeObject *intern_limited(const Shape *shape,
+                                            std::vector<ValueKind> slot_kinds,
+                                            ValueKind array_kind);
 
-    bool is_circular_reference() const noexcept { return circular_reference_; }
+    const TypeObject *transit(const Transition &transition) const;
 
-    bool operator==(const TypeObject &other) const {
-        return (circular_reference_ == other.circular_reference_) &&
-               (hash_table_types_ == other.hash_table_types_) &&
-               (array_types_ == other.array_types_);
-    };
+    friend struct TypeObjectEqualTo;
+    friend struct TypeObjectHash;
+    friend class TypeTable;
 
-    size_t hash() const {
-        if (circular_reference_) {
-            // We return non 0 value because we distinguish circular
-            // reference TypeObject from empty TypeObject
-            return -1;
-        }
+public:
+    static constexpr std::size_t max_types_per_shape = 16;
 
-        size_t hash = 0;
+    TypeObject(const TypeObject &) = delete;
+    TypeObject(TypeObject &&) = delete;
+    TypeObject &operator=(const TypeObject &) = delete;
+    TypeObject &operator=(TypeObject &&) = delete;
 
-        for (auto &&[k, v] : hash_table_types_) {
-            hash ^= std::hash<std::string>()(k);
-            hash ^= v->hash();
-        }
+    /// @brief The type of new objects.
+    static const TypeObject *root();
 
-        for (auto &&v : array_types_) {
-            hash ^= v->hash();
-        }
+    const Shape *shape() const noexcept { return shape_; }
 
-        return hash;
+    /// @return kind of slot, or ValueKind::none if shape() doesn't have the
+    /// slot.
+    ValueKind slot_kind(std::size_t slot) const noexcept {
+        return slot < slot_kinds_.size() ? slot_kinds_[slot]
+                                         : ValueKind::none;
     }
-};
 
-struct TypeHash {
-    size_t operator()(const std::shared_ptr<TypeObject> &type) const {
-        return type->hash();
-    }
-};
-
-struct TypeEqualTo {
-    size_t operator()(const std::shared_ptr<TypeObject> &type1,
-                      const std::shared_ptr<TypeObject> &type2) const {
-        return *type1 == *type2;
+    ValueKind array_kind() const noexcept { return array_kind_; }
+
+    /// @brief Unique and dense id of this type.
+    /// @details Ids are stable while the process runs and the root type is 0.
+    uint64_t id() const noexcept { return id_; }
+
+    /// @brief Get the type after a value of kind is stored to slot.
+    /// @param shape shape of the object after the store
+    const TypeObject *with_slot(const Shape *shape, std::size_t slot,
+                                ValueKind kind) const {
+        // Kinds of slots of dictionaries are not tracked.
+        if (shape == shape_ &&
+            (shape->is_dictionary() || slot_kind(slot) == kind ||
+             slot_kind(slot) == ValueKind::mixed)) {
+            return this;
+        }
+        return transit({shape, slot, kind});
     }
-};
 
-struct TypeSet {
-    std::mutex mutex;
-    std::unordered_set<std::shared_ptr<TypeObject>, TypeHash, TypeEqualTo> set;
-};
-
-static TypeSet global_type_set;
-inline std::shared_ptr<TypeObject> calculate_type(Object &obj) {
-    TypeCalcData data;
-    return calculate_type(obj, data);
-}
-
-inline std::shared_ptr<TypeObject>
-calculate_type(Object &obj, TypeCalcData &type_calc_data) {
-    if (type_calc_data.objects_in_calculation.count(&obj) != 0) {
-        return TypeObject::create_circular_reference_type_object();
+    /// @brief Get the type after a value of kind is pushed or set to the
+    /// array.
+    const TypeObject *with_array_element(ValueKind kind) const {
+        if (join(array_kind_, kind) == array_kind_) {
+            return this;
+        }
+        return transit({shape_, array_transition, kind});
     }
 
-    type_calc_data.objects_in_calculation.insert(&obj);
-
-    try {
-        auto type_object = std::make_shared<TypeObject>();
-
-        for (auto &&kv : obj.iter_hash_table()){
-            if (kv.key.is_object_key()) {
-                throw "not implemented";
-            }
-
-            type_object->hash_table_types_[kv.key.get_key_as_c_str()] =
-                kv.value->calculate_type(type_calc_data);
+    static ValueKind join(ValueKind a, ValueKind b) noexcept {
+        if (a == b || b == ValueKind::none) {
+            return a;
         }
-
-
-        for (auto iter = obj.iter_array(); !iter.is_end(); iter = iter.next()) {
-            type_object->array_types_.push_back(
-                iter.get()->calculate_type(type_calc_data));
+        if (a == ValueKind::none) {
+            return b;
         }
-
-        std::lock_guard lk{global_type_set.mutex};
-        auto &type_set = global_type_set.set;
-        auto [type_iter, is_inserted] = type_set.insert(type_object);
-        return *type_iter;
-    } catch (const BrokenIteratorError &e) {
-        std::cerr << "calculate_type: BrokenIteratorError: " << e.what()
-                  << '\n';
-        return nullptr;
+        return ValueKind::mixed;
     }
-}
+};
 
 } // namespace ljf
-
-template <> struct std::hash<ljf::TypeObject> {
-    size_t operator()(const ljf::TypeObject &type) const { return type.hash(); }
-};
@@ -1,13 +1,131 @@
 #pragma once
 
+#include <cstddef>
+
 // User's custom configuration is implicitly incluted by CONFIG_FILE Makefile
 // variable and -include clang option.
 
+// Set true to count calls of a function per type of the argument, which is
+// required by the specialization.
+// If false, calls of a function are counted together.
 #if !defined(LJF_CALCULATE_TYPE)
-#define LJF_CALCULATE_TYPE false
+#define LJF_CALCULATE_TYPE true
 #endif // LJF_CALCULATE_TYPE
 
+// Set false if objects are never shared between threads.
+// Then reference counts are updated without atomic read-modify-write.
+// It requires LJF_CONCURRENT_CYCLE_COLLECTION false.
+#if !defined(LJF_ATOMIC_REFCOUNT)
+#define LJF_ATOMIC_REFCOUNT true
+#endif // LJF_ATOMIC_REFCOUNT
+
+// Set false to count references from handles of contexts eagerly.
+// If true, objects referred by handles are owned by a context and
+// reference counting for the handles is deferred to release of the context.
+#if !defined(LJF_DEFERRED_REFCOUNT)
+#define LJF_DEFERRED_REFCOUNT true
+#endif // LJF_DEFERRED_REFCOUNT
+
+// Number of calls of a compiled function with one argument type after which
+// the function is recompiled in the background for the type: interned keys
+// are folded and variables of the argument are accessed by slot index.
+// The recompiled code is used for calls with the type.
+// 0 or LJF_CALCULATE_TYPE false disables the specialization.
+#if !defined(LJF_SPECIALIZATION_THRESHOLD)
+#define LJF_SPECIALIZATION_THRESHOLD 1000
+#endif // LJF_SPECIALIZATION_THRESHOLD
+
+// Set true to compile modules in process by LLVM ORC LLJIT.
+// If false, modules are compiled to shared libraries by clang++ and dlopen()ed.
+#if !defined(LJF_ORC_JIT)
+#define LJF_ORC_JIT false
+#endif // LJF_ORC_JIT
+
+// Optimization level (0-3) of modules at loading.
+// Modules can override it by "ljf-opt-level" module flag.
+#if !defined(LJF_MODULE_OPT_LEVEL)
+#define LJF_MODULE_OPT_LEVEL 0
+#endif // LJF_MODULE_OPT_LEVEL
+
+// Optimization level (0-3) of specialized functions, which are hot.
+#if !defined(LJF_SPECIALIZATION_OPT_LEVEL)
+#define LJF_SPECIALIZATION_OPT_LEVEL 2
+#endif // LJF_SPECIALIZATION_OPT_LEVEL
+
+// Optimization level (0-3) of modules recompiled in the background after
+// loading. If it is higher than the level of loading, functions of the module
+// are replaced by the recompiled ones when it is ready.
+#if !defined(LJF_BACKGROUND_OPT_LEVEL)
+#define LJF_BACKGROUND_OPT_LEVEL 2
+#endif // LJF_BACKGROUND_OPT_LEVEL
+
+// Number of threads compiling in the background.
+#if !defined(LJF_COMPILE_THREADS)
+#define LJF_COMPILE_THREADS 2
+#endif // LJF_COMPILE_THREADS
+
+// Set false to disable collecting cyclic garbage.
+// If true, all objects are registered to the cycle collector.
+#if !defined(LJF_CYCLE_COLLECTION)
+#define LJF_CYCLE_COLLECTION true
+#endif // LJF_CYCLE_COLLECTION
+
+// Number of objects allocated between automatic cycle collections.
+// If 0, cycles are collected only by ljf_internal_collect_cycles().
+#if !defined(LJF_CYCLE_COLLECTION_THRESHOLD)
+#define LJF_CYCLE_COLLECTION_THRESHOLD 1000000
+#endif // LJF_CYCLE_COLLECTION_THRESHOLD
+
+// Set true to collect cycles automatically on a background thread while
+// mutators run. If false, the thread reaching the threshold collects them,
+// locking all objects.
+#if !defined(LJF_CONCURRENT_CYCLE_COLLECTION)
+#define LJF_CONCURRENT_CYCLE_COLLECTION true
+#endif // LJF_CONCURRENT_CYCLE_COLLECTION
+
+// Max number of objects locked at once by a concurrent cycle collection.
+// A garbage cycle larger than it is locked at once.
+#if !defined(LJF_CYCLE_COLLECTION_MAX_PAUSE_OBJECTS)
+#define LJF_CYCLE_COLLECTION_MAX_PAUSE_OBJECTS 10000
+#endif // LJF_CYCLE_COLLECTION_MAX_PAUSE_OBJECTS
+
 namespace ljf::config {
 static constexpr bool calculate_type = LJF_CALCULATE_TYPE;
 #undef LJF_CALCULATE_TYPE
+static constexpr bool atomic_refcount = LJF_ATOMIC_REFCOUNT;
+#undef LJF_ATOMIC_REFCOUNT
+static constexpr bool deferred_refcount = LJF_DEFERRED_REFCOUNT;
+#undef LJF_DEFERRED_REFCOUNT
+static constexpr std::size_t specialization_threshold =
+    LJF_SPECIALIZATION_THRESHOLD;
+#undef LJF_SPECIALIZATION_THRESHOLD
+static constexpr bool orc_jit = LJF_ORC_JIT;
+#undef LJF_ORC_JIT
+static constexpr unsigned module_opt_level = LJF_MODULE_OPT_LEVEL;
+#undef LJF_MODULE_OPT_LEVEL
+static constexpr unsigned specialization_opt_level =
+    LJF_SPECIALIZATION_OPT_LEVEL;
+#undef LJF_SPECIALIZATION_OPT_LEVEL
+static constexpr unsigned background_opt_level = LJF_BACKGROUND_OPT_LEVEL;
+#undef LJF_BACKGROUND_OPT_LEVEL
+static_assert(module_opt_level <= 3 && specialization_opt_level <= 3 &&
+              background_opt_level <= 3);
+static constexpr std::size_t compile_threads = LJF_COMPILE_THREADS;
+#undef LJF_COMPILE_THREADS
+static constexpr bool cycle_collection = LJF_CYCLE_COLLECTION;
+#undef LJF_CYCLE_COLLECTION
+static constexpr std::size_t cycle_collection_threshold =
+    LJF_CYCLE_COLLECTION_THRESHOLD;
+#undef LJF_CYCLE_COLLECTION_THRESHOLD
+static constexpr bool concurrent_cycle_collection =
+    LJF_CONCURRENT_CYCLE_COLLECTION;
+#undef LJF_CONCURRENT_CYCLE_COLLECTION
+static constexpr std::size_t cycle_collection_max_pause_objects =
+    LJF_CYCLE_COLLECTION_MAX_PAUSE_OBJECTS;
+#undef LJF_CYCLE_COLLECTION_MAX_PAUSE_OBJECTS
+// The background collector pins objects while mutators update their counts.
+static_assert(atomic_refcount ||
+                  !(cycle_collection && concurrent_cycle_collection),
+              "LJF_ATOMIC_REFCOUNT false requires "
+              "LJF_CONCURRENT_CYCLE_COLLECTION false");
 } // namespace ljf::config
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <optional>
+
+#include "Object.hpp"
+#include "runtime-internal.hpp"
+
+namespace ljf::internal {
+
+template <typename T> T unboxed_value_as(const Object::ValueType &value);
+
+template <>
+inline int64_t unboxed_value_as<int64_t>(const Object::ValueType &value) {
+    if (!value.is_int64()) {
+        throw ljf::runtime_error("value is not int64");
+    }
+    return value.as_int64();
+}
+
+template <>
+inline double unboxed_value_as<double>(const Object::ValueType &value) {
+    if (!value.is_double()) {
+        throw ljf::runtime_error("value is not double");
+    }
+    return value.as_double();
+}
+
+template <typename T>
+T get_unboxed(Context *ctx, LJFHandle obj, LJFHandle key, LJFAttribute attr,
+              T default_value) {
+    auto key_ptr = ctx->get_key_from_handle(key, attr);
+    auto value = ctx->get_from_handle(obj)->get_unboxed(key_ptr, attr);
+    if (!value) {
+        return default_value;
+    }
+    return unboxed_value_as<T>(*value);
+}
+
+/// @brief Convert handle of a value to ValueType.
+/// Fixnum is converted to unboxed int64.
+inline Object::ValueType value_from_handle(Context *ctx, LJFHandle handle,
+                                           LJFAttribute attr) {
+    if (ljf_is_fixnum(handle)) {
+        return Object::ValueType::from_int64(attr, ljf_fixnum_value(handle));
+    }
+    return Object::ValueType{attr, ctx->get_from_handle(handle)};
+}
+
+/// @brief Convert value returned by Object::get_value() to handle.
+/// Unboxed int64 is converted to fixnum if it fits.
+inline LJFHandle
+handle_from_value(Context *ctx, const std::optional<Object::ValueType> &value,
+                  LJFHandle default_value) {
+    if (!value) {
+        return default_value;
+    }
+    if (value->is_int64() && ljf_fixnum_fits(value->as_int64())) {
+        return ljf_make_fixnum(value->as_int64());
+    }
+    if (value->is_object() && !value->as_object()) {
+        return default_value;
+    }
+    return ctx->register_temporary_object(
+        Object::to_incremented_object(value));
+}
+
+} // namespace ljf::internal
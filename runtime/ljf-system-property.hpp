@@ -7,6 +7,7 @@
 namespace ljf::internal {
 
 constexpr auto ljf_native_value_int64 = "ljf.native_value_int64";
+constexpr auto ljf_native_value_double = "ljf.native_value_double";
 
 constexpr auto ljf_native_value_c_str = "ljf.native_value_c_str";
 constexpr auto ljf_c_str_length = "ljf.c_str_length";
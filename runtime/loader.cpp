@@ -1,20 +1,47 @@
 #include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/Bitcode/BitcodeReader.h>
 #include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/ExecutionEngine/Orc/CompileUtils.h>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
 #include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/InstIterator.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/ModuleSummaryIndex.h>
+#include <llvm/IR/Operator.h>
 #include <llvm/IR/Verifier.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/Passes/PassBuilder.h>
 #include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
 #include <llvm/Support/Path.h>
+#include <llvm/Support/SHA1.h>
+#include <llvm/Support/TargetSelect.h>
 #include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/Utils/Cloning.h>
 
 #include <dlfcn.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <functional>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <optional>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
+#include "CompileQueue.hpp"
+#include "TypeObject.hpp"
 #include "ljf/ljf.hpp"
 #include "runtime-internal.hpp"
 #include <ljf/runtime.hpp>
@@ -33,11 +60,15 @@ struct SmallString : llvm::SmallString<32> {
 namespace ljf {
 namespace {
     llvm::LLVMContext llvm_context;
+    // guards llvm_context and modules in it
+    std::mutex llvm_context_mutex;
 
     struct LoaderContext {
         CompilerMap compiler_map;
         std::string ljf_tmpdir;
         std::string ljf_runtime_filename;
+        // compiled modules kept across runs, unlike ljf_tmpdir
+        std::string ljf_cache_dir;
     };
     // set by ljf::initialize()
     std::unique_ptr<LoaderContext> context = nullptr;
@@ -59,6 +90,757 @@ namespace {
 } // namespace
 } // namespace ljf
 
+namespace ljf {
+namespace {
+    /// Runtime API functions which take a key and its attribute.
+    struct KeyOperand {
+        const char *function_name;
+        unsigned key_index;
+        unsigned attr_index;
+    };
+    constexpr KeyOperand key_operands[] = {
+        {"ljf_get", 2, 3},
+        {"ljf_set", 2, 4},
+        {"ljf_get_with_cache", 2, 3},
+        {"ljf_set_with_cache", 2, 4},
+        {"ljf_environment_get", 2, 3},
+        {"ljf_environment_set", 2, 4},
+        {"ljf_get_int64", 2, 3},
+        {"ljf_set_int64", 2, 4},
+        {"ljf_get_double", 2, 3},
+        {"ljf_set_double", 2, 4},
+        {"ljf_environment_get_int64", 2, 3},
+        {"ljf_environment_set_int64", 2, 4},
+        {"ljf_environment_get_double", 2, 3},
+        {"ljf_environment_set_double", 2, 4},
+        {"ljf_environment_resolve", 2, 3},
+    };
+
+    /// Replace string literal keys given to runtime API with symbols, and
+    /// emit code interning the symbols at ir_builder, which should be in
+    /// ljf_module_init().
+    /// So keys of literals are hashed once at module loading, not per access.
+    void intern_literal_keys(llvm::Module &module,
+                             llvm::IRBuilder<> &ir_builder) {
+        auto &llvm_context = module.getContext();
+        auto i64_ty = llvm::Type::getInt64Ty(llvm_context);
+        auto i8_ptr_ty = llvm::Type::getInt8PtrTy(llvm_context);
+        auto ljf_intern_symbol = module.getOrInsertFunction(
+            "ljf_intern_symbol",
+            llvm::FunctionType::get(i64_ty, {i8_ptr_ty}, false));
+
+        // string -> global variable holding the symbol of it
+        std::map<std::string, llvm::GlobalVariable *> symbols;
+
+        for (auto &&key_operand : key_operands) {
+            auto fn = module.getFunction(key_operand.function_name);
+            if (!fn) {
+                continue;
+            }
+            for (auto user : fn->users()) {
+                auto call = llvm::dyn_cast<llvm::CallInst>(user);
+                if (!call || call->getCalledFunction() != fn) {
+                    continue;
+                }
+
+                auto attr = llvm::dyn_cast<llvm::ConstantInt>(
+                    call->getArgOperand(key_operand.attr_index));
+                if (!attr || (attr->getZExtValue() & LJF_ATTR_KEY_TYPE_MASK) !=
+                                 LJF_ATTR_C_STR_KEY) {
+                    continue;
+                }
+
+                llvm::Value *key = call->getArgOperand(key_operand.key_index);
+                if (!key->getType()->isIntegerTy(64)) {
+                    continue;
+                }
+                if (auto cast = llvm::dyn_cast<llvm::PtrToIntOperator>(key)) {
+                    key = cast->getPointerOperand();
+                }
+                llvm::StringRef str;
+                if (!llvm::isa<llvm::Constant>(key) ||
+                    !llvm::getConstantStringInfo(key, str)) {
+                    continue;
+                }
+
+                auto &symbol = symbols[str.str()];
+                if (!symbol) {
+                    symbol = new llvm::GlobalVariable(
+                        module, i64_ty, false,
+                        llvm::GlobalValue::InternalLinkage,
+                        llvm::ConstantInt::get(i64_ty, 0), "ljf.symbol");
+                    auto key_ptr = ir_builder.CreatePointerCast(key, i8_ptr_ty);
+                    ir_builder.CreateStore(
+                        ir_builder.CreateCall(ljf_intern_symbol, {key_ptr}),
+                        symbol);
+                }
+
+                llvm::IRBuilder<> call_builder{call};
+                call->setArgOperand(key_operand.key_index,
+                                    call_builder.CreateLoad(i64_ty, symbol));
+                call->setArgOperand(
+                    key_operand.attr_index,
+                    llvm::ConstantInt::get(
+                        attr->getType(),
+                        (attr->getZExtValue() & ~LJF_ATTR_KEY_TYPE_MASK) |
+                            LJF_ATTR_SYMBOL_KEY));
+            }
+        }
+    }
+
+    /// @brief Function returning the address of a symbol of a loaded module.
+    /// It throws if no such symbol.
+    using SymbolLookup = std::function<void *(const std::string &name)>;
+
+    /// @brief Compiled code of a module loaded in this process.
+    struct LoadedModule {
+        SymbolLookup lookup;
+        /// module_cache_key() of the code
+        std::string cache_key;
+        /// shared library, set by load_with_clang()
+        std::string so_path;
+        /// whether so_path is in ljf_cache_dir. Otherwise so_path is in
+        /// ljf_tmpdir, which is removed on the next run.
+        bool so_cached = false;
+        /// set by load_with_orc_jit()
+        llvm::orc::JITDylib *jit_dylib = nullptr;
+    };
+
+    /// @brief Code first loaded from each module given by compilers, which
+    /// defines the global variables of the module.
+    /// Guarded by llvm_context_mutex.
+    std::map<const llvm::Module *, LoadedModule> loaded_modules;
+
+    /// @brief Give functions and global variables defined by module external
+    /// linkage, so that code compiled later from a copy of module can refer
+    /// to the definitions loaded first instead of defining its own copies.
+    /// @details Constants are not exported, because copies of them can't be
+    /// told apart.
+    void export_module_definitions(llvm::Module &module) {
+        auto export_value = [](llvm::GlobalValue &value) {
+            if (value.isDeclaration() || !value.hasLocalLinkage()) {
+                return;
+            }
+            if (!value.hasName()) {
+                value.setName("ljf.global");
+            }
+            value.setLinkage(llvm::GlobalValue::ExternalLinkage);
+            value.setVisibility(llvm::GlobalValue::DefaultVisibility);
+        };
+        for (auto &&fn : module.functions()) {
+            export_value(fn);
+        }
+        for (auto &&var : module.globals()) {
+            if (!var.isConstant() && !var.getName().startswith("llvm.")) {
+                export_value(var);
+            }
+        }
+    }
+
+    using Bitcode = llvm::SmallVector<char, 0>;
+
+    Bitcode write_bitcode(const llvm::Module &module) {
+        Bitcode bitcode;
+        llvm::raw_svector_ostream out{bitcode};
+        llvm::WriteBitcodeToFile(module, out);
+        return bitcode;
+    }
+
+    std::unique_ptr<llvm::Module>
+    read_bitcode(const Bitcode &bitcode, llvm::StringRef name,
+                 llvm::LLVMContext &target_context) {
+        auto module = llvm::parseBitcodeFile(
+            llvm::MemoryBufferRef{
+                llvm::StringRef{bitcode.data(), bitcode.size()}, name},
+            target_context);
+        if (!module) {
+            throw ljf::runtime_error("reading module " + name.str() +
+                                     " failed: " +
+                                     llvm::toString(module.takeError()));
+        }
+        return std::move(*module);
+    }
+
+    /// @brief Run the optimization pipeline of opt_level (0-3) on module by
+    /// the new pass manager.
+    /// @details O0 runs nothing, to make startup fast.
+    void optimize_module(llvm::Module &module, unsigned opt_level) {
+        if (opt_level == 0) {
+            return;
+        }
+
+        llvm::LoopAnalysisManager loop_analysis_manager;
+        llvm::FunctionAnalysisManager function_analysis_manager;
+        llvm::CGSCCAnalysisManager cgscc_analysis_manager;
+        llvm::ModuleAnalysisManager module_analysis_manager;
+
+        llvm::PassBuilder pass_builder;
+        pass_builder.registerModuleAnalyses(module_analysis_manager);
+        pass_builder.registerCGSCCAnalyses(cgscc_analysis_manager);
+        pass_builder.registerFunctionAnalyses(function_analysis_manager);
+        pass_builder.registerLoopAnalyses(loop_analysis_manager);
+        pass_builder.crossRegisterProxies(
+            loop_analysis_manager, function_analysis_manager,
+            cgscc_analysis_manager, module_analysis_manager);
+
+        const llvm::OptimizationLevel levels[] = {
+            llvm::OptimizationLevel::O0, llvm::OptimizationLevel::O1,
+            llvm::OptimizationLevel::O2, llvm::OptimizationLevel::O3};
+        auto pass_manager = pass_builder.buildPerModuleDefaultPipeline(
+            levels[std::min(opt_level, 3u)]);
+        pass_manager.run(module, module_analysis_manager);
+    }
+
+    /// @return optimization level of module: "ljf-opt-level" module flag set
+    /// by the compiler of the module, or default_level.
+    unsigned module_opt_level(const llvm::Module &module,
+                              unsigned default_level) {
+        auto flag = llvm::mdconst::extract_or_null<llvm::ConstantInt>(
+            module.getModuleFlag("ljf-opt-level"));
+        return flag ? flag->getZExtValue() : default_level;
+    }
+
+    /// @brief Load runtime-inline.bc placed next to runtime.so.
+    /// @return nullptr if it is not found
+    std::unique_ptr<llvm::Module> load_runtime_inline_library() {
+        SmallString path{context->ljf_runtime_filename};
+        llvm::sys::path::remove_filename(path);
+        llvm::sys::path::append(path, "runtime-inline.bc");
+
+        auto buffer = llvm::MemoryBuffer::getFile(path);
+        if (!buffer) {
+            verbs() << "ljf: " << path << " not found, runtime API is not "
+                    << "inlined\n";
+            return nullptr;
+        }
+        auto library = llvm::parseBitcodeFile(**buffer, llvm_context);
+        if (!library) {
+            throw ljf::runtime_error("reading " + path.str().str() +
+                                     " failed: " +
+                                     llvm::toString(library.takeError()));
+        }
+        // Static initializers belong to runtime.so.
+        if (auto ctors = (*library)->getNamedGlobal("llvm.global_ctors")) {
+            ctors->eraseFromParent();
+        }
+        return std::move(*library);
+    }
+
+    /// @brief Link runtime API functions defined in runtime-inline.bc into
+    /// module so that LLVM can inline them.
+    /// @details Linked API functions become available_externally, so calls
+    /// not inlined still go to runtime.so. Linked variables become
+    /// declarations, so that module shares them with runtime.so.
+    void link_runtime_inline_library(llvm::Module &module) {
+        static const std::unique_ptr<llvm::Module> library =
+            load_runtime_inline_library();
+        if (!library) {
+            return;
+        }
+
+        std::vector<std::string> api_functions;
+        for (auto &&fn : library->functions()) {
+            if (!fn.isDeclaration() && fn.hasExternalLinkage()) {
+                api_functions.push_back(fn.getName().str());
+            }
+        }
+        std::vector<std::string> variables;
+        for (auto &&var : library->globals()) {
+            if (!var.hasLocalLinkage()) {
+                variables.push_back(var.getName().str());
+            }
+        }
+
+        auto copy = llvm::CloneModule(*library);
+        copy->setDataLayout(module.getDataLayout());
+        copy->setTargetTriple(module.getTargetTriple());
+        if (llvm::Linker::linkModules(module, std::move(copy),
+                                      llvm::Linker::LinkOnlyNeeded)) {
+            throw ljf::runtime_error("linking runtime-inline.bc to " +
+                                     module.getModuleIdentifier() + " failed");
+        }
+
+        for (auto &&name : api_functions) {
+            auto fn = module.getFunction(name);
+            if (fn && !fn->isDeclaration()) {
+                fn->setLinkage(llvm::GlobalValue::AvailableExternallyLinkage);
+                fn->setComdat(nullptr);
+            }
+        }
+        for (auto &&name : variables) {
+            auto var = module.getNamedGlobal(name);
+            if (var && !var->isDeclaration()) {
+                var->setInitializer(nullptr);
+                var->setLinkage(llvm::GlobalValue::ExternalLinkage);
+                var->setComdat(nullptr);
+            }
+        }
+    }
+
+    /// @brief First line of `clang++ --version`, or empty if it failed.
+    std::string clang_version() {
+        std::string version;
+        if (auto pipe = popen("clang++ --version 2>/dev/null", "r")) {
+            for (int c; (c = std::fgetc(pipe)) != EOF && c != '\n';) {
+                version.push_back(static_cast<char>(c));
+            }
+            pclose(pipe);
+        }
+        return version;
+    }
+
+    /// @brief Key of compiled code of bitcode in ljf_cache_dir.
+    /// @details It is a hash of bitcode and everything else the compiled code
+    /// depends on: the runtime, the backend and its version, the optimization
+    /// level and the code defining the declarations of bitcode. Bitcode of a module doesn't
+    /// contain FunctionIds, so the key doesn't depend on the order of loading
+    /// modules.
+    std::string module_cache_key(const Bitcode &bitcode, unsigned opt_level,
+                                 const LoadedModule *base) {
+        static const std::string runtime_stamp = [] {
+            // The runtime ABI changes only when runtime.so is rebuilt.
+            llvm::sys::fs::file_status status;
+            if (auto err_code = llvm::sys::fs::status(
+                    context->ljf_runtime_filename, status)) {
+                throw std::system_error(
+                    err_code, "stat ljf runtime \"" +
+                                  context->ljf_runtime_filename + "\" failed");
+            }
+            return context->ljf_runtime_filename + ":" +
+                   std::to_string(status.getSize()) + ":" +
+                   std::to_string(status.getLastModificationTime()
+                                      .time_since_epoch()
+                                      .count());
+        }();
+
+        llvm::SHA1 hasher;
+        hasher.update("ljf module cache v1\n");
+        hasher.update(runtime_stamp + "\n");
+        // Passes of optimize_module() come from LLVM linked to the runtime.
+        hasher.update("LLVM " LLVM_VERSION_STRING "\n");
+        if constexpr (config::orc_jit) {
+            hasher.update("orc");
+        } else {
+            static const std::string clang = clang_version();
+            hasher.update("clang " + clang);
+        }
+        hasher.update(" -O" + std::to_string(opt_level) + "\n");
+        if (base) {
+            hasher.update("base " + base->cache_key + "\n");
+        }
+        hasher.update(llvm::StringRef{bitcode.data(), bitcode.size()});
+        return llvm::toHex(hasher.final(), /* LowerCase */ true);
+    }
+
+    /// @brief Move file at path to cache_path atomically, so that other
+    /// processes never see incomplete files.
+    /// @return whether the file is moved. Otherwise it is left at path.
+    bool publish_to_cache(const llvm::Twine &path,
+                          const llvm::Twine &cache_path) {
+        if (auto err_code = llvm::sys::fs::rename(path, cache_path)) {
+            // not cached, but usable
+            llvm::errs() << "ljf: caching " << path << " failed: "
+                         << err_code.message() << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    /// @brief Compile bitcode of module to a shared library by clang++ and
+    /// dlopen it.
+    /// @details Shared libraries are cached in ljf_cache_dir, so same module
+    /// is compiled once across runs. If base is given, the library depends on
+    /// the library of base, which defines declarations of the module.
+    /// The library refers to the library of base by path, so it is cached
+    /// only if the library of base is cached.
+    LoadedModule load_with_clang(const Bitcode &bitcode,
+                                 const std::string &module_id,
+                                 unsigned opt_level, const LoadedModule *base) {
+        const auto cache_key = module_cache_key(bitcode, opt_level, base);
+        const bool cacheable = !base || base->so_cached;
+        const std::string cache_path =
+            context->ljf_cache_dir + "/" + cache_key + ".so";
+        std::string so_path = cache_path;
+        bool so_cached = cacheable && llvm::sys::fs::exists(cache_path);
+
+        if (so_cached) {
+            verbs() << "ljf: use cached " << so_path << "\n";
+        } else {
+            // Optimize a copy, because the module may be cloned later for
+            // specialization.
+            llvm::LLVMContext optimize_context;
+            auto optimized_module =
+                read_bitcode(bitcode, module_id, optimize_context);
+            optimize_module(*optimized_module, opt_level);
+            const auto optimized_bitcode = write_bitcode(*optimized_module);
+
+            std::string output_bc_dir = context->ljf_tmpdir + "/" + module_id;
+            if (auto err_code =
+                    llvm::sys::fs::create_directories(output_bc_dir)) {
+                throw std::system_error(err_code);
+            }
+
+            SmallString output_bc_path;
+            if (auto err_code = llvm::sys::fs::createUniqueFile(
+                    output_bc_dir + "/ljf-%%-%%-%%-%%.bc", output_bc_path)) {
+                throw std::system_error(err_code);
+            }
+
+            {
+                std::error_code EC;
+                llvm::raw_fd_ostream out{output_bc_path, EC};
+                if (EC) {
+                    throw std::system_error(EC);
+                }
+
+                out.write(optimized_bitcode.data(), optimized_bitcode.size());
+            }
+
+            // compile
+            SmallString output_so_path = output_bc_path;
+
+            llvm::sys::path::replace_extension(output_so_path, "so");
+
+            // IR is already optimized, so clang++ only generates code.
+            // The library of base is already loaded, so the dynamic loader
+            // resolves declarations to it instead of loading it again.
+            SmallString compile_command_line =
+                "clang++ -L/usr/local/opt/llvm/lib -lLLVM " + output_bc_path +
+                " " + (base ? base->so_path + " " : "") +
+                context->ljf_runtime_filename + " -shared -O" +
+                std::to_string(opt_level) + " -Xclang -disable-llvm-passes" +
+                " -o " + output_so_path;
+            llvm::errs() << compile_command_line << '\n';
+            if (auto e = std::system(compile_command_line.c_str())) {
+                throw ljf::runtime_error(
+                    "compile failed: exited with " + std::to_string(e) +
+                    ", command line: " + compile_command_line.c_str());
+            }
+
+            so_cached =
+                cacheable && publish_to_cache(output_so_path, cache_path);
+            so_path = so_cached ? cache_path : output_so_path.str().str();
+        }
+
+        auto module_handle = dlopen(so_path.c_str(), RTLD_LAZY | RTLD_LOCAL);
+        if (!module_handle) {
+            throw std::runtime_error("dlopen failed: "s + dlerror());
+        }
+        LoadedModule loaded;
+        loaded.lookup = [module_handle](const std::string &name) {
+            auto addr = dlsym(module_handle, name.c_str());
+            if (!addr) {
+                throw std::runtime_error("dlsym failed: "s + dlerror());
+            }
+            return addr;
+        };
+        loaded.cache_key = cache_key;
+        loaded.so_path = so_path;
+        loaded.so_cached = so_cached;
+        return loaded;
+    }
+
+    /// @brief Object files compiled by ORC JIT in ljf_cache_dir.
+    /// Modules are identified by their module identifier, which is set to
+    /// module_cache_key().
+    std::string cached_object_path(const std::string &cache_key) {
+        return context->ljf_cache_dir + "/" + cache_key + ".o";
+    }
+
+    class ModuleObjectCache : public llvm::ObjectCache {
+    private:
+        static std::string object_path(const llvm::Module *module) {
+            return cached_object_path(module->getModuleIdentifier());
+        }
+
+    public:
+        void notifyObjectCompiled(const llvm::Module *module,
+                                  llvm::MemoryBufferRef object) override {
+            SmallString tmp_path;
+            int fd;
+            if (auto err_code = llvm::sys::fs::createUniqueFile(
+                    context->ljf_cache_dir + "/tmp-%%-%%-%%-%%.o", fd,
+                    tmp_path)) {
+                llvm::errs() << "ljf: caching object failed: "
+                             << err_code.message() << "\n";
+                return;
+            }
+            {
+                llvm::raw_fd_ostream out{fd, /* shouldClose */ true};
+                out << object.getBuffer();
+            }
+            publish_to_cache(tmp_path, object_path(module));
+        }
+
+        std::unique_ptr<llvm::MemoryBuffer>
+        getObject(const llvm::Module *module) override {
+            auto buffer = llvm::MemoryBuffer::getFile(object_path(module));
+            if (!buffer) {
+                return nullptr;
+            }
+            verbs() << "ljf: use cached " << object_path(module) << "\n";
+            return std::move(*buffer);
+        }
+    };
+
+    llvm::orc::LLJIT &get_orc_jit() {
+        static std::unique_ptr<llvm::orc::LLJIT> jit = [] {
+            llvm::InitializeNativeTarget();
+            llvm::InitializeNativeTargetAsmPrinter();
+
+            static ModuleObjectCache object_cache;
+
+            auto jit = llvm::cantFail(
+                llvm::orc::LLJITBuilder()
+                    .setCompileFunctionCreator(
+                        [](llvm::orc::JITTargetMachineBuilder builder)
+                            -> llvm::Expected<std::unique_ptr<
+                                llvm::orc::IRCompileLayer::IRCompiler>> {
+                            return std::make_unique<
+                                llvm::orc::ConcurrentIRCompiler>(
+                                std::move(builder), &object_cache);
+                        })
+                    .create());
+            // Resolve runtime API from runtime.so loaded in this process.
+            jit->getMainJITDylib().addGenerator(llvm::cantFail(
+                llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+                    jit->getDataLayout().getGlobalPrefix())));
+            return jit;
+        }();
+        return *jit;
+    }
+
+    /// @brief Compile module in this process by ORC LLJIT.
+    /// @details Each module is added to its own JITDylib, because modules
+    /// may define the same symbols such as module_main. If base is given,
+    /// declarations of the module are resolved to the JITDylib of base.
+    LoadedModule load_with_orc_jit(const Bitcode &bitcode,
+                                   const std::string &module_id,
+                                   unsigned opt_level,
+                                   const LoadedModule *base) {
+        static std::atomic<std::size_t> jit_dylib_count = 0;
+        auto &jit = get_orc_jit();
+
+        // JIT needs to own the module and its context.
+        auto jit_context = std::make_unique<llvm::LLVMContext>();
+        auto jit_module = read_bitcode(bitcode, module_id, *jit_context);
+        const auto cache_key = module_cache_key(bitcode, opt_level, base);
+        // used by ModuleObjectCache
+        jit_module->setModuleIdentifier(cache_key);
+        if (!llvm::sys::fs::exists(cached_object_path(cache_key))) {
+            optimize_module(*jit_module, opt_level);
+        }
+
+        auto &jit_dylib = llvm::cantFail(jit.createJITDylib(
+            "ljf-module-" + std::to_string(jit_dylib_count++)));
+        if (base) {
+            jit_dylib.addToLinkOrder(*base->jit_dylib);
+        }
+        jit_dylib.addToLinkOrder(jit.getMainJITDylib());
+        llvm::orc::ThreadSafeModule thread_safe_module{std::move(jit_module),
+                                                       std::move(jit_context)};
+        if (auto err =
+                jit.addIRModule(jit_dylib, std::move(thread_safe_module))) {
+            throw ljf::runtime_error("ORC JIT: adding module failed: " +
+                                     llvm::toString(std::move(err)));
+        }
+
+        LoadedModule loaded;
+        loaded.lookup = [&jit, &jit_dylib](const std::string &name) {
+            auto symbol = jit.lookup(jit_dylib, name);
+            if (!symbol) {
+                throw std::runtime_error("ORC JIT: lookup of " + name +
+                                         " failed: " +
+                                         llvm::toString(symbol.takeError()));
+            }
+            return reinterpret_cast<void *>(symbol->getAddress());
+        };
+        loaded.cache_key = cache_key;
+        loaded.jit_dylib = &jit_dylib;
+        return loaded;
+    }
+
+    /// @brief Compile bitcode of a module by the backend selected by
+    /// LJF_ORC_JIT and load it.
+    /// @param base code defining declarations of bitcode, or nullptr
+    /// @details This doesn't touch llvm_context, so callers don't need to
+    /// hold llvm_context_mutex.
+    LoadedModule compile_and_load(const Bitcode &bitcode,
+                                  const std::string &module_id,
+                                  unsigned opt_level,
+                                  const LoadedModule *base = nullptr) {
+        if constexpr (config::orc_jit) {
+            return load_with_orc_jit(bitcode, module_id, opt_level, base);
+        } else {
+            return load_with_clang(bitcode, module_id, opt_level, base);
+        }
+    }
+
+    /// @brief Make module, a copy of the module loaded as base, share the
+    /// state of base.
+    /// @details Global variables exported by export_module_definitions()
+    /// become declarations resolved to base, whose module_main() initialized
+    /// them. ljf_module_init() only sets functions, because base already
+    /// interned the symbols.
+    void share_loaded_state(llvm::Module &module) {
+        if (auto init_fn = module.getFunction("ljf_module_init")) {
+            std::vector<llvm::Instruction *> interning;
+            for (auto &&inst : llvm::instructions(init_fn)) {
+                auto store = llvm::dyn_cast<llvm::StoreInst>(&inst);
+                if (!store) {
+                    continue;
+                }
+                auto call =
+                    llvm::dyn_cast<llvm::CallInst>(store->getValueOperand());
+                if (call && call->getCalledFunction() &&
+                    call->getCalledFunction()->getName() ==
+                        "ljf_intern_symbol") {
+                    interning.push_back(store);
+                    interning.push_back(call);
+                }
+            }
+            for (auto inst : interning) {
+                inst->eraseFromParent();
+            }
+        }
+
+        for (auto &&var : module.globals()) {
+            if (var.isDeclaration() || var.isConstant() ||
+                var.hasLocalLinkage() || var.getName().startswith("llvm.")) {
+                continue;
+            }
+            var.setInitializer(nullptr);
+            var.setLinkage(llvm::GlobalValue::ExternalLinkage);
+            var.setComdat(nullptr);
+        }
+    }
+
+    /// @brief Recompile bitcode at opt_level in the background, and replace
+    /// functions of the module loaded from it as base by the recompiled ones.
+    void recompile_in_background(Bitcode bitcode, std::string module_id,
+                                 unsigned opt_level, const LoadedModule &base,
+                                 std::vector<FunctionId> function_ids) {
+        CompileQueue::global().submit([bitcode = std::move(bitcode),
+                                       module_id = std::move(module_id),
+                                       opt_level, &base,
+                                       function_ids = std::move(function_ids)] {
+            try {
+                // llvm_context is not touched, so no lock is needed.
+                llvm::LLVMContext recompile_context;
+                auto module =
+                    read_bitcode(bitcode, module_id, recompile_context);
+                share_loaded_state(*module);
+                auto loaded = compile_and_load(write_bitcode(*module),
+                                               module_id, opt_level, &base);
+                // ljf_module_init() of the recompiled module sets its
+                // functions to the function table.
+                auto ljf_module_init =
+                    reinterpret_cast<void (*)(const uint64_t *)>(
+                        loaded.lookup("ljf_module_init"));
+                ljf_module_init(function_ids.data());
+            } catch (const std::exception &e) {
+                // Calls continue to go to the code loaded first.
+                llvm::errs() << "ljf: background compile of " << module_id
+                             << " failed: " << e.what() << "\n";
+            }
+        });
+    }
+
+    /// @brief Make symbol variables of clone, which is a copy of module,
+    /// constants defined by clone.
+    /// @details The variables are initialized by ljf_module_init() of module,
+    /// which is not called for clone, and interned symbols never change.
+    void fold_interned_symbols(const llvm::Module &module, llvm::Module &clone,
+                               llvm::ValueToValueMapTy &vmap) {
+        auto init_fn = module.getFunction("ljf_module_init");
+        if (!init_fn) {
+            return;
+        }
+        auto i64_ty = llvm::Type::getInt64Ty(clone.getContext());
+        for (auto &&inst : llvm::instructions(init_fn)) {
+            auto store = llvm::dyn_cast<llvm::StoreInst>(&inst);
+            if (!store) {
+                continue;
+            }
+            auto call =
+                llvm::dyn_cast<llvm::CallInst>(store->getValueOperand());
+            auto symbol = llvm::dyn_cast<llvm::GlobalVariable>(
+                store->getPointerOperand());
+            if (!call || !symbol || !call->getCalledFunction() ||
+                call->getCalledFunction()->getName() != "ljf_intern_symbol") {
+                continue;
+            }
+            llvm::StringRef str;
+            if (!llvm::getConstantStringInfo(
+                    call->getArgOperand(0)->stripPointerCasts(), str)) {
+                continue;
+            }
+            auto cloned_symbol =
+                llvm::cast<llvm::GlobalVariable>(vmap[symbol]);
+            cloned_symbol->setInitializer(llvm::ConstantInt::get(
+                i64_ty, ljf_intern_symbol(str.str().c_str())));
+            cloned_symbol->setConstant(true);
+            cloned_symbol->setLinkage(llvm::GlobalValue::InternalLinkage);
+        }
+    }
+
+    /// @return value of v if it is a constant integer or a load of a
+    /// constant variable of it, such as a folded symbol.
+    std::optional<uint64_t> constant_int_value(const llvm::Value *v) {
+        if (auto load = llvm::dyn_cast<llvm::LoadInst>(v)) {
+            auto var = llvm::dyn_cast<llvm::GlobalVariable>(
+                load->getPointerOperand()->stripPointerCasts());
+            if (!var || !var->isConstant() ||
+                !var->hasDefinitiveInitializer()) {
+                return std::nullopt;
+            }
+            v = var->getInitializer();
+        }
+        if (auto c = llvm::dyn_cast<llvm::ConstantInt>(v)) {
+            return c->getZExtValue();
+        }
+        return std::nullopt;
+    }
+
+    /// @brief Environment API replaced by specialize_function_for_type().
+    /// @details The replacement takes the arguments of the API followed by
+    /// the shape and the slot index.
+    struct SlotAccess {
+        const char *name;
+        const char *specialized_name;
+        std::size_t attr_index;
+        // kind the slot must have, or ValueKind::none for any kind
+        ValueKind kind;
+    };
+    const SlotAccess slot_accesses[] = {
+        {"ljf_environment_get", "ljf_internal_environment_get_at", 3,
+         ValueKind::none},
+        {"ljf_environment_set", "ljf_internal_environment_set_at", 4,
+         ValueKind::none},
+        {"ljf_environment_get_int64", "ljf_internal_environment_get_int64_at",
+         3, ValueKind::int64},
+        {"ljf_environment_set_int64", "ljf_internal_environment_set_int64_at",
+         4, ValueKind::none},
+        {"ljf_environment_get_double",
+         "ljf_internal_environment_get_double_at", 3, ValueKind::double_value},
+        {"ljf_environment_set_double",
+         "ljf_internal_environment_set_double_at", 4, ValueKind::none},
+    };
+
+    const SlotAccess *find_slot_access(const llvm::Function *callee) {
+        if (!callee) {
+            return nullptr;
+        }
+        for (auto &&access : slot_accesses) {
+            if (callee->getName() == access.name) {
+                return &access;
+            }
+        }
+        return nullptr;
+    }
+} // namespace
+} // namespace ljf
+
 namespace ljf::internal {
 
 /// return: returned object of module_main()
@@ -66,6 +848,7 @@ ObjectHolder load_source_code(const std::string &language,
                               const std::string &source_path, Object *env) {
 
     check_context_initialized();
+    std::unique_lock lk{llvm_context_mutex};
     if (!context->compiler_map.count(language)) {
         throw std::invalid_argument("No such compiler for `" + language + "`");
     }
@@ -82,7 +865,13 @@ ObjectHolder load_source_code(const std::string &language,
     }
 
     auto module_func_table = make_new_held_object();
-    std::map<FunctionId, llvm::Function *> func_to_register;
+    // Functions are set to the function table by ljf_module_init(), which
+    // receives their ids as an argument. Ids depend on the order of loading
+    // modules, so they are kept out of the code, which is cached across runs.
+    std::vector<llvm::Function *> func_to_register;
+    std::vector<FunctionId> function_ids;
+    // functions having "ljf-arity" attribute are fast functions.
+    std::map<FunctionId, uint64_t> fast_function_arity;
 
     for (auto &func : module->functions()) {
         verbs() << "*** begin registering function"
@@ -106,7 +895,18 @@ ObjectHolder load_source_code(const std::string &language,
         verbs() << "registering " << name << ": ";
 
         auto id = ljf_internal_register_llvm_function(&func, module);
-        func_to_register[id] = &func;
+        func_to_register.push_back(&func);
+        function_ids.push_back(id);
+        if (func.hasFnAttribute("ljf-arity")) {
+            uint64_t arity;
+            if (func.getFnAttribute("ljf-arity")
+                    .getValueAsString()
+                    .getAsInteger(10, arity)) {
+                throw ljf::runtime_error("invalid ljf-arity of function " +
+                                         name.str());
+            }
+            fast_function_arity[id] = arity;
+        }
         ljf_set_function_id_to_function_table(module_func_table.get(),
                                               func.getName().data(), id);
 
@@ -123,12 +923,15 @@ ObjectHolder load_source_code(const std::string &language,
         // auto ljf_object_ty = llvm::StructType::create(llvm_context,
         // "ljf::Object"); auto ljf_object_ptr_ty =
         // llvm::PointerType::get(ljf_object_ty, 0);
-        auto ljf_module_init_fn_ty = llvm::FunctionType::get(void_ty, {});
+        auto i64_ty = llvm::Type::getInt64Ty(llvm_context);
+        auto i64_ptr_ty = llvm::PointerType::get(i64_ty, 0);
+        // void ljf_module_init(const uint64_t *function_ids)
+        auto ljf_module_init_fn_ty =
+            llvm::FunctionType::get(void_ty, {i64_ptr_ty}, false);
         auto ljf_module_init_fn = llvm::Function::Create(
             ljf_module_init_fn_ty, llvm::Function::ExternalLinkage,
             "ljf_module_init", *module);
 
-        auto i64_ty = llvm::Type::getInt64Ty(llvm_context);
         auto ljf_internal_set_native_function_ty =
             llvm::FunctionType::get(void_ty, {i64_ty, i8_ptr_ty}, false);
         auto ljf_internal_set_native_function =
@@ -136,20 +939,47 @@ ObjectHolder load_source_code(const std::string &language,
                                    llvm::Function::ExternalLinkage,
                                    "ljf_internal_set_native_function", *module);
 
+        auto ljf_internal_set_fast_function_ty = llvm::FunctionType::get(
+            void_ty, {i64_ty, i8_ptr_ty, i64_ty}, false);
+        auto ljf_internal_set_fast_function =
+            llvm::Function::Create(ljf_internal_set_fast_function_ty,
+                                   llvm::Function::ExternalLinkage,
+                                   "ljf_internal_set_fast_function", *module);
+
         llvm::IRBuilder ir_builder{llvm_context};
 
         auto bb =
             llvm::BasicBlock::Create(llvm_context, "entry", ljf_module_init_fn);
         ir_builder.SetInsertPoint(bb);
 
-        for (const auto &[id, fn] : func_to_register) {
-            auto id_const = llvm::ConstantInt::get(i64_ty, id);
+        auto function_ids_arg = ljf_module_init_fn->getArg(0);
+        for (std::size_t i = 0; i < func_to_register.size(); i++) {
+            auto fn = func_to_register[i];
+            auto id_const = ir_builder.CreateLoad(
+                i64_ty, ir_builder.CreateConstGEP1_64(i64_ty, function_ids_arg,
+                                                      i));
             auto casted_fn_ptr = ir_builder.CreateBitCast(fn, i8_ptr_ty);
+            auto arity = fast_function_arity.find(function_ids[i]);
+            if (arity != fast_function_arity.end()) {
+                ir_builder.CreateCall(
+                    ljf_internal_set_fast_function,
+                    {id_const, casted_fn_ptr,
+                     llvm::ConstantInt::get(i64_ty, arity->second)});
+                continue;
+            }
             ir_builder.CreateCall(ljf_internal_set_native_function,
                                   {id_const, casted_fn_ptr});
         }
+        intern_literal_keys(*module, ir_builder);
         ir_builder.CreateRetVoid();
     }
+    export_module_definitions(*module);
+
+    if constexpr (!config::orc_jit) {
+        // Inlined code refers thread local variables of runtime.so, which
+        // RuntimeDyld of ORC JIT can't relocate.
+        link_runtime_inline_library(*module);
+    }
 
     {
         // dump
@@ -164,65 +994,190 @@ ObjectHolder load_source_code(const std::string &language,
         out << *module;
     }
 
-    std::string output_bc_dir =
-        context->ljf_tmpdir + "/" + module->getModuleIdentifier();
-    if (auto err_code = llvm::sys::fs::create_directories(output_bc_dir)) {
-        throw std::system_error(err_code);
-    }
+    auto bitcode = write_bitcode(*module);
+    const auto module_id = module->getModuleIdentifier();
+    const auto opt_level = module_opt_level(*module, config::module_opt_level);
+    // compile without lock, and module_main() may load other modules.
+    lk.unlock();
 
-    SmallString output_bc_path;
-    if (auto err_code = llvm::sys::fs::createUniqueFile(
-            output_bc_dir + "/ljf-%%-%%-%%-%%.bc", output_bc_path)) {
-        throw std::system_error(err_code);
+    auto loaded = compile_and_load(bitcode, module_id, opt_level);
+    auto module_main_addr = loaded.lookup("module_main");
+    auto ljf_module_init_addr = loaded.lookup("ljf_module_init");
+    const LoadedModule *base;
+    {
+        // Functions of module may be specialized once they are set by
+        // ljf_module_init().
+        std::lock_guard lk{llvm_context_mutex};
+        // Entries of loaded_modules are never erased.
+        base = &loaded_modules.emplace(module, std::move(loaded)).first->second;
     }
 
-    {
-        std::error_code EC;
-        llvm::raw_fd_ostream out{output_bc_path, EC};
-        if (EC) {
-            throw std::system_error(EC);
-        }
+    auto ljf_module_init =
+        reinterpret_cast<void (*)(const uint64_t *)>(ljf_module_init_addr);
+    ljf_module_init(function_ids.data());
 
-        llvm::WriteBitcodeToFile(*module, out);
+    if (config::background_opt_level > opt_level) {
+        // Start running the module quickly, and optimize it concurrently.
+        recompile_in_background(std::move(bitcode), module_id,
+                                config::background_opt_level, *base,
+                                function_ids);
     }
 
-    // compile
-    SmallString output_so_path = output_bc_path;
+    auto module_main =
+        reinterpret_cast<Object *(*)(Object *, Object *)>(module_main_addr);
+
+    ObjectHolder ret = module_main(env, module_func_table.get());
+    return ret;
+}
 
-    llvm::sys::path::replace_extension(output_so_path, "so");
+void specialize_function_for_type(llvm::Function &fn,
+                                  llvm::Function &fallback,
+                                  const TypeObject &type) {
+    if (fn.arg_size() != 2) {
+        throw ljf::runtime_error("specialize: not a FunctionPtr");
+    }
+    auto &module = *fn.getParent();
+    auto &llvm_context = fn.getContext();
+    auto i64_ty = llvm::Type::getInt64Ty(llvm_context);
+    auto i8_ptr_ty = llvm::Type::getInt8PtrTy(llvm_context);
+    auto env = fn.getArg(1);
+    // The shape is immortal, so its address is a constant.
+    auto shape = llvm::ConstantExpr::getIntToPtr(
+        llvm::ConstantInt::get(i64_ty,
+                               reinterpret_cast<uintptr_t>(type.shape())),
+        i8_ptr_ty);
 
-    SmallString compile_command_line =
-        "clang++ -L/usr/local/opt/llvm/lib -lLLVM " + output_bc_path + " " +
-        context->ljf_runtime_filename + " -shared -o " + output_so_path;
-    llvm::errs() << compile_command_line << '\n';
-    if (auto e = std::system(compile_command_line.c_str())) {
-        throw ljf::runtime_error(
-            "compile failed: exited with " + std::to_string(e) +
-            ", command line: " + compile_command_line.c_str());
+    struct Replacement {
+        llvm::CallInst *call;
+        const SlotAccess *access;
+        std::size_t slot;
+    };
+    std::vector<Replacement> replacements;
+    for (auto &&inst : llvm::instructions(fn)) {
+        auto call = llvm::dyn_cast<llvm::CallInst>(&inst);
+        if (!call) {
+            continue;
+        }
+        auto access = find_slot_access(call->getCalledFunction());
+        if (!access || call->getArgOperand(1) != env) {
+            continue;
+        }
+        auto key = constant_int_value(call->getArgOperand(2));
+        auto attr = constant_int_value(call->getArgOperand(access->attr_index));
+        if (!key || !attr ||
+            AttributeTraits::mask(static_cast<LJFAttribute>(*attr),
+                                  LJF_ATTR_KEY_TYPE_MASK) !=
+                LJF_ATTR_SYMBOL_KEY) {
+            continue;
+        }
+        auto slot = type.shape()->find_slot(
+            Key{static_cast<LJFAttribute>(*attr),
+                reinterpret_cast<const void *>(*key)});
+        if (!slot || (access->kind != ValueKind::none &&
+                      type.slot_kind(*slot) != access->kind)) {
+            continue;
+        }
+        replacements.push_back({call, access, *slot});
     }
 
-    auto module_handle = dlopen(output_so_path.c_str(), RTLD_LAZY | RTLD_LOCAL);
-    if (!module_handle) {
-        throw std::runtime_error("dlopen failed: "s + dlerror());
+    for (auto &&[call, access, slot] : replacements) {
+        auto callee_ty = call->getFunctionType();
+        std::vector<llvm::Type *> params{callee_ty->param_begin(),
+                                         callee_ty->param_end()};
+        params.push_back(i8_ptr_ty);
+        params.push_back(i64_ty);
+        auto specialized_callee = module.getOrInsertFunction(
+            access->specialized_name,
+            llvm::FunctionType::get(callee_ty->getReturnType(), params,
+                                    false));
+        std::vector<llvm::Value *> args{call->arg_begin(), call->arg_end()};
+        args.push_back(shape);
+        args.push_back(llvm::ConstantInt::get(i64_ty, slot));
+        auto new_call =
+            llvm::CallInst::Create(specialized_callee, args, "", call);
+        new_call->takeName(call);
+        call->replaceAllUsesWith(new_call);
+        call->eraseFromParent();
     }
-    auto module_main_addr = dlsym(module_handle, "module_main");
-    if (!module_main_addr) {
-        throw std::runtime_error("dlsym failed: "s + dlerror());
+
+    // Guard the entry by the type after allocas, which must stay in the
+    // entry block to be promoted to registers.
+    auto &entry = fn.getEntryBlock();
+    auto body_begin = entry.getFirstInsertionPt();
+    while (llvm::isa<llvm::AllocaInst>(*body_begin)) {
+        ++body_begin;
     }
+    auto body = entry.splitBasicBlock(body_begin, "specialized");
+    entry.getTerminator()->eraseFromParent();
 
-    auto ljf_module_init_addr = dlsym(module_handle, "ljf_module_init");
-    if (!ljf_module_init_addr) {
-        throw std::runtime_error("dlsym failed: "s + dlerror());
+    auto other_type = llvm::BasicBlock::Create(llvm_context, "other_type", &fn);
+    llvm::IRBuilder ir_builder{other_type};
+    std::vector<llvm::Value *> args;
+    for (auto &&arg : fn.args()) {
+        args.push_back(&arg);
     }
+    auto ret = ir_builder.CreateCall(&fallback, args);
+    ret->setTailCall();
+    ir_builder.CreateRet(ret);
 
-    auto ljf_module_init = reinterpret_cast<void (*)()>(ljf_module_init_addr);
-    ljf_module_init();
+    ir_builder.SetInsertPoint(&entry);
+    auto type_id_fn = module.getOrInsertFunction(
+        "ljf_internal_environment_type_id",
+        llvm::FunctionType::get(i64_ty, {env->getType()}, false));
+    auto type_id = ir_builder.CreateCall(type_id_fn, {env});
+    ir_builder.CreateCondBr(
+        ir_builder.CreateICmpEQ(type_id,
+                                llvm::ConstantInt::get(i64_ty, type.id())),
+        body, other_type);
+}
 
-    auto module_main =
-        reinterpret_cast<Object *(*)(Object *, Object *)>(module_main_addr);
+FunctionPtr compile_specialized_function(const llvm::Function &fn,
+                                         const TypeObject &type) {
+    check_context_initialized();
+    // llvm_context is not thread safe.
+    std::unique_lock lk{llvm_context_mutex};
 
-    ObjectHolder ret = module_main(env, module_func_table.get());
-    return ret;
+    auto &module = *fn.getParent();
+    const auto &base = loaded_modules.at(&module);
+    llvm::ValueToValueMapTy vmap;
+    // The copy defines only fn and what is inlined into it. Other functions
+    // and global variables are declarations resolved to base, so the copy
+    // shares the state of the module and doesn't initialize it again.
+    auto clone =
+        llvm::CloneModule(module, vmap, [&fn](const llvm::GlobalValue *value) {
+            if (value == &fn || value->hasLocalLinkage() ||
+                value->hasAvailableExternallyLinkage() ||
+                value->getName().startswith("llvm.")) {
+                return true;
+            }
+            auto var = llvm::dyn_cast<llvm::GlobalVariable>(value);
+            return var && var->isConstant();
+        });
+    for (auto name : {"llvm.global_ctors", "llvm.global_dtors"}) {
+        if (auto var = clone->getNamedGlobal(name)) {
+            var->eraseFromParent();
+        }
+    }
+    fold_interned_symbols(module, *clone, vmap);
+
+    auto specialized = llvm::cast<llvm::Function>(vmap[&fn]);
+    specialized->setName(fn.getName() + ".ljf.specialized");
+    specialized->setLinkage(llvm::GlobalValue::ExternalLinkage);
+    // resolved to fn of base
+    auto fallback =
+        llvm::Function::Create(fn.getFunctionType(),
+                               llvm::GlobalValue::ExternalLinkage,
+                               fn.getName(), *clone);
+    specialize_function_for_type(*specialized, *fallback, type);
+    const auto name = specialized->getName().str();
+    const auto bitcode = write_bitcode(*clone);
+    const auto module_id = clone->getModuleIdentifier();
+    // Entries of loaded_modules are never erased.
+    lk.unlock();
+
+    auto loaded = compile_and_load(bitcode, module_id,
+                                   config::specialization_opt_level, &base);
+    return reinterpret_cast<FunctionPtr>(loaded.lookup(name));
 }
 
 } // namespace ljf::internal
@@ -238,8 +1193,8 @@ void ljf_internal_initialize(const CompilerMap &compiler_map,
         throw std::logic_error("ljf::initialize() is called twice or more");
     }
 
-    context = std::make_unique<LoaderContext>(
-        LoaderContext{compiler_map, ljf_tmpdir, runtime_filename});
+    context = std::make_unique<LoaderContext>(LoaderContext{
+        compiler_map, ljf_tmpdir, runtime_filename, ljf_tmpdir + "-cache"});
 
     // remove ljf_tmpdir
     if (auto err_code =
@@ -260,6 +1215,34 @@ void ljf_internal_initialize(const CompilerMap &compiler_map,
                                               context->ljf_tmpdir +
                                               "\" failed");
     }
+
+    // ljf_cache_dir is reused, but only by the owner.
+    if (auto err_code = llvm::sys::fs::create_directories(
+            context->ljf_cache_dir,
+            /* IgnoreExisting */ true, llvm::sys::fs::perms::owner_all)) {
+        throw std::system_error(err_code, "create ljf cache dir \"" +
+                                              context->ljf_cache_dir +
+                                              "\" failed");
+    }
+    // for security, code in ljf_cache_dir is loaded without checking, so
+    // fail if other users can place files in an existing ljf_cache_dir.
+    llvm::sys::fs::file_status cache_dir_status;
+    if (auto err_code = llvm::sys::fs::status(context->ljf_cache_dir,
+                                              cache_dir_status)) {
+        throw std::system_error(err_code, "stat ljf cache dir \"" +
+                                              context->ljf_cache_dir +
+                                              "\" failed");
+    }
+    if (cache_dir_status.type() != llvm::sys::fs::file_type::directory_file ||
+        cache_dir_status.getUser() != ::getuid() ||
+        (cache_dir_status.permissions() &
+         (llvm::sys::fs::perms::group_write |
+          llvm::sys::fs::perms::others_write))) {
+        throw ljf::runtime_error(
+            "ljf cache dir \"" + context->ljf_cache_dir +
+            "\" must be a directory owned by the current user and not "
+            "writable by others");
+    }
 }
 } // extern "C"
 
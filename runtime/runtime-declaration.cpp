@@ -1,9 +1,16 @@
 #include <ljf/runtime.hpp>
 
 extern "C" void ljf_dummy(void (*touch)(...)) {
-    touch(ljf_get, ljf_set, ljf_get_function_id_from_function_table,
-          ljf_set_function_id_to_function_table, ljf_call_function, ljf_new,
+    touch(ljf_get, ljf_set, ljf_get_with_cache, ljf_set_with_cache,
+          ljf_get_function_id_from_function_table,
+          ljf_set_function_id_to_function_table, ljf_call_function,
+          ljf_call_function_fast, ljf_register_native_fast_function, ljf_new,
           ljf_get_native_data, ljf_environment_get, ljf_environment_set,
           ljf_register_native_function, ljf_array_size, ljf_array_set,
-          ljf_array_push, ljf_wrap_c_str);
+          ljf_array_push, ljf_wrap_c_str, ljf_intern_symbol, ljf_get_int64,
+          ljf_set_int64, ljf_get_double, ljf_set_double,
+          ljf_environment_get_int64, ljf_environment_set_int64,
+          ljf_environment_get_double, ljf_environment_set_double,
+          ljf_environment_resolve, ljf_environment_get_slot,
+          ljf_environment_set_slot);
 }
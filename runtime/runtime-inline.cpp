@@ -0,0 +1,88 @@
+// Runtime API functions small enough to be inlined into compiled code.
+// This file is compiled into runtime.so, and also into runtime-inline.bc
+// which the loader links into modules as available_externally definitions.
+// So functions here must not use anything local to runtime.so
+// (static variables or functions of other translation units).
+
+#include "InlineCache.hpp"
+#include "Object.hpp"
+#include "handle-conversion.hpp"
+#include "ljf/runtime.hpp"
+#include "runtime-internal.hpp"
+
+using namespace ljf;
+using namespace ljf::internal;
+
+extern "C" {
+
+/**************** table API ***************/
+LJFHandle ljf_get(ljf::Context *ctx, LJFHandle obj, LJFHandle key,
+                  LJFAttribute attr, LJFHandle default_value) {
+
+    auto key_ptr = ctx->get_key_from_handle(key, attr);
+    auto value = ctx->get_from_handle(obj)->get_value(key_ptr, attr);
+    return handle_from_value(ctx, value, default_value);
+}
+
+void ljf_set(Context *ctx, LJFHandle obj, LJFHandle key_handle_or_cstr,
+             LJFHandle value, LJFAttribute attr) {
+    auto key = ctx->get_key_from_handle(key_handle_or_cstr, attr);
+    ctx->get_from_handle(obj)->set_value(
+        key, value_from_handle(ctx, value, attr), attr);
+}
+
+LJFHandle ljf_get_with_cache(ljf::Context *ctx, LJFHandle obj, LJFHandle key,
+                             LJFAttribute attr, LJFHandle default_value,
+                             LJFInlineCache *cache) {
+
+    auto key_ptr = ctx->get_key_from_handle(key, attr);
+    auto value = ctx->get_from_handle(obj)->get_value(
+        key_ptr, attr, InlineCache::from(cache));
+    return handle_from_value(ctx, value, default_value);
+}
+
+void ljf_set_with_cache(ljf::Context *ctx, LJFHandle obj,
+                        LJFHandle key_handle_or_cstr, LJFHandle value,
+                        LJFAttribute attr, LJFInlineCache *cache) {
+    auto key = ctx->get_key_from_handle(key_handle_or_cstr, attr);
+    ctx->get_from_handle(obj)->set_value(key,
+                                         value_from_handle(ctx, value, attr),
+                                         attr, InlineCache::from(cache));
+}
+
+int64_t ljf_get_int64(Context *ctx, LJFHandle obj, LJFHandle key,
+                      LJFAttribute attr, int64_t default_value) {
+    return get_unboxed(ctx, obj, key, attr, default_value);
+}
+
+void ljf_set_int64(Context *ctx, LJFHandle obj, LJFHandle key, int64_t value,
+                   LJFAttribute attr) {
+    ctx->get_from_handle(obj)->set_value(
+        ctx->get_key_from_handle(key, attr),
+        Object::ValueType::from_int64(attr, value), attr);
+}
+
+double ljf_get_double(Context *ctx, LJFHandle obj, LJFHandle key,
+                      LJFAttribute attr, double default_value) {
+    return get_unboxed(ctx, obj, key, attr, default_value);
+}
+
+void ljf_set_double(Context *ctx, LJFHandle obj, LJFHandle key, double value,
+                    LJFAttribute attr) {
+    ctx->get_from_handle(obj)->set_value(
+        ctx->get_key_from_handle(key, attr),
+        Object::ValueType::from_double(attr, value), attr);
+}
+
+/**************** array API ***************/
+size_t ljf_array_size(Context *ctx, LJFHandle obj_h) {
+    return ctx->get_from_handle(obj_h)->array_size();
+}
+
+/**************** new API ***************/
+uint64_t ljf_get_native_data(const Object *obj) {
+
+    return obj->get_native_data();
+}
+
+} // extern "C"
@@ -1,34 +1,199 @@
 #pragma once
 
 #include "AttributeTraits.hpp"
+#include "HandleArena.hpp"
 #include "ObjectHolder.hpp"
+#include "ThreadToken.hpp"
+#include "config.hpp"
 #include <ljf/ljf.hpp>
 #include <ljf/runtime.hpp>
 
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
 #include <deque>
+#include <memory>
 
 namespace llvm {
 class Function;
 } // namespace llvm
 
 namespace ljf {
+class Shape;
+class TypeObject;
+
+/// @brief Result of acquire_deferred_ownership()
+enum class DeferredOwnership {
+    /// The context became the owner. The context must release ownership.
+    acquired,
+    /// The context or its older context of same thread already owns the
+    /// object.
+    owned,
+    /// Other thread owns the object. Use counted reference instead.
+    not_owned,
+};
+
+/// @brief Make the context of seq owner of obj if possible.
+/// @details While an object is owned by a context its refcount doesn't
+/// include references from handles, and the object is not deleted even if its
+/// refcount is 0. Owner context checks refcount when it releases ownership.
+/// Caller must guarantee obj is alive while this function is called.
+DeferredOwnership acquire_deferred_ownership(Object *obj,
+                                             uint64_t context_seq);
+/// @brief Release ownership of obj if the context of seq, or a younger
+/// context of the thread, owns it, and delete obj if there are no other
+/// references.
+void release_deferred_ownership(Object *obj, uint64_t context_seq);
 
 // TODO Write why Context and holding object pointer is required.
+/// @brief Holder of objects referred by handles during a function call.
+/// @details Handles are pushed to HandleArena of the current thread, so
+/// contexts must be released by the thread which created them; otherwise
+/// the process is aborted. Contexts are expected to be released in LIFO
+/// order. A context released while a younger context of the thread is alive
+/// hands its handles over to the younger context, which releases them.
+/// A context may register handles while younger contexts are alive; such
+/// handles are kept in a separately allocated overflow until it is released.
 class Context {
 private:
     class TemporaryHolders {
     private:
-        std::deque<ObjectHolder> holders_;
+        // A smaller seq means an older context.
+        static uint64_t new_seq() {
+            static thread_local uint64_t seq_counter = 0;
+            return ++seq_counter;
+        }
+
+        uint64_t seq_ = new_seq();
+        const uintptr_t thread_ = current_thread_token();
+        HandleArena &arena_ = HandleArena::current();
+        HandleArena::Mark mark_ = arena_.mark();
+        // Contexts of the thread next to this context on arena_.
+        TemporaryHolders *older_ =
+            static_cast<TemporaryHolders *>(arena_.owner());
+        TemporaryHolders *younger_ = nullptr;
+        // Handles registered while a younger context is alive, that is, while
+        // this context cannot push to arena_.
+        std::unique_ptr<std::deque<HandleEntry>> overflow_;
+
+        Object **add_handle(Object *obj, HandleKind kind) {
+            if (arena_.owner() == this) {
+                return &arena_.push(obj, kind)->obj;
+            }
+            if (!overflow_) {
+                overflow_ = std::make_unique<std::deque<HandleEntry>>();
+            }
+            overflow_->push_back(HandleEntry{obj, kind});
+            return &overflow_->back().obj;
+        }
+
+        /// @brief Take over handles of older, which is released before this
+        /// context.
+        void inherit(TemporaryHolders &older) {
+            // Entries of older are just below entries of this context.
+            mark_ = older.mark_;
+            // Objects owned by older are released by this context.
+            seq_ = older.seq_;
+            older_ = older.older_;
+            if (older_) {
+                older_->younger_ = this;
+            }
+            if (older.overflow_) {
+                if (!overflow_) {
+                    overflow_ = std::move(older.overflow_);
+                } else {
+                    for (auto &&entry : *older.overflow_) {
+                        overflow_->push_back(entry);
+                    }
+                }
+            }
+        }
+
+        void release(const HandleEntry &entry) {
+            switch (entry.kind) {
+            case HandleKind::plain:
+                break;
+            case HandleKind::counted:
+                decrement_ref_count(entry.obj);
+                break;
+            case HandleKind::owned:
+                release_deferred_ownership(entry.obj, seq_);
+                break;
+            }
+        }
 
     public:
-        ObjectHolder *add(IncrementedObjectPtr &&obj) {
-            holders_.push_back(std::move(obj));
-            return &holders_.back();
+        TemporaryHolders() {
+            if (older_) {
+                older_->younger_ = this;
+            }
+            arena_.set_owner(this);
+        }
+        TemporaryHolders(const TemporaryHolders &) = delete;
+        TemporaryHolders &operator=(const TemporaryHolders &) = delete;
+
+        Object **add(IncrementedObjectPtr &&obj) {
+            auto raw = reinterpret_cast<Object *>(static_cast<uintptr_t>(obj));
+            obj = IncrementedObjectPtr::NULL_PTR;
+
+            if constexpr (config::deferred_refcount) {
+                switch (acquire_deferred_ownership(raw, seq_)) {
+                case DeferredOwnership::acquired:
+                    // handles don't need to be counted.
+                    decrement_ref_count(raw);
+                    return add_handle(raw, HandleKind::owned);
+                case DeferredOwnership::owned:
+                    decrement_ref_count(raw);
+                    return add_handle(raw, HandleKind::plain);
+                case DeferredOwnership::not_owned:
+                    break;
+                }
+            }
+            return add_handle(raw, HandleKind::counted);
+        }
+
+        Object **add(Object *obj) {
+            if constexpr (config::deferred_refcount) {
+                switch (acquire_deferred_ownership(obj, seq_)) {
+                case DeferredOwnership::acquired:
+                    return add_handle(obj, HandleKind::owned);
+                case DeferredOwnership::owned:
+                    return add_handle(obj, HandleKind::plain);
+                case DeferredOwnership::not_owned:
+                    break;
+                }
+            }
+            increment_ref_count(obj);
+            return add_handle(obj, HandleKind::counted);
         }
 
-        ObjectHolder *add(Object *obj) {
-            holders_.push_back(obj);
-            return &holders_.back();
+        /// @brief Whether handles were registered while a younger context
+        /// was alive, for tests.
+        bool has_overflow() const noexcept { return overflow_ != nullptr; }
+
+        ~TemporaryHolders() {
+            if (thread_ != current_thread_token()) {
+                // arena_ and deferred ownership belong to the creator thread.
+                std::fputs("LJF: a context must be released by the thread "
+                           "which created it\n",
+                           stderr);
+                std::abort();
+            }
+            if (younger_) {
+                younger_->inherit(*this);
+                return;
+            }
+            if (overflow_) {
+                for (auto it = overflow_->rbegin(); it != overflow_->rend();
+                     ++it) {
+                    release(*it);
+                }
+            }
+            arena_.pop_to(mark_, [this](auto &&entry) { release(entry); });
+            if (older_) {
+                older_->younger_ = nullptr;
+            }
+            arena_.set_owner(older_);
         }
     };
     TemporaryHolders temporary_holders_;
@@ -39,35 +204,48 @@ public:
     explicit Context(llvm::Module *LLVMModule, Context *caller_context)
         : LLVMModule_(LLVMModule), caller_context_(caller_context) {}
 
-    // On this implementation, LJFHandle is address of local ObjectHolder in
-    // TemporaryHolders
+    // On this implementation, LJFHandle is address of Object * in
+    // HandleArena or TemporaryHolders
     LJFHandle
     register_temporary_object(IncrementedObjectPtr &&obj) {
         return reinterpret_cast<LJFHandle>(
             temporary_holders_.add(std::move(obj)));
     }
 
-    // On this implementation, LJFHandle is address of local ObjectHolder in
-    // TemporaryHolders
+    // On this implementation, LJFHandle is address of Object * in
+    // HandleArena or TemporaryHolders
     LJFHandle register_temporary_object(Object *obj) {
         return reinterpret_cast<LJFHandle>(temporary_holders_.add(obj));
     }
 
     Object *get_from_handle(LJFHandle handle) {
-        return reinterpret_cast<ObjectHolder *>(handle)->get();
+        if (ljf_is_fixnum(handle)) {
+            return box_fixnum(handle);
+        }
+        return *reinterpret_cast<Object **>(handle);
     }
 
+    /// @brief Make an object of fixnum and register it to this context.
+    Object *box_fixnum(LJFHandle fixnum);
+
+    /// @return C string, Symbol or Object according to the key type of attr
     const void *get_key_from_handle(LJFHandle handle, LJFAttribute attr) {
         if (AttributeTraits::mask(attr, LJF_ATTR_KEY_TYPE_MASK) ==
-            LJF_ATTR_C_STR_KEY) {
-            return const_cast<const void *>(reinterpret_cast<void *>(handle));
+            LJF_ATTR_OBJECT_KEY) {
+            return get_from_handle(handle);
         } else {
-            return reinterpret_cast<ObjectHolder *>(handle)->get();
+            // C string or Symbol
+            return const_cast<const void *>(reinterpret_cast<void *>(handle));
         }
     }
 
     llvm::Module *get_llvm_module() const { return LLVMModule_; }
 
+    /// @brief Whether the overflow of handles is allocated, for tests.
+    bool has_overflow() const noexcept {
+        return temporary_holders_.has_overflow();
+    }
+
     Context *get_caller_context() const { return caller_context_; }
 };
 
@@ -92,11 +270,29 @@ inline std::unique_ptr<Context> make_temporary_context() {
     return std::make_unique<Context>(nullptr, nullptr);
 }
 
-ObjectHolder create_environment(Context *, bool prepare_0th_frame = true);
+ObjectHolder create_environment(Context *);
 ObjectHolder create_callee_environment(Environment *parent, Object *arg);
 
 ObjectHolder load_source_code(const std::string &language,
                               const std::string &source_path, Object *env);
+
+/// @brief Compile a copy of fn, a function of a loaded module, specialized
+/// to calls whose argument has type.
+/// @details Interned keys are folded into constants, and variables of the
+/// argument frame are accessed by slot index of the shape of type.
+/// The copy calls fn if the argument has another type.
+/// @return function pointer of the compiled copy
+FunctionPtr compile_specialized_function(const llvm::Function &fn,
+                                         const TypeObject &type);
+
+/// @brief Rewrite fn to code for an argument frame of type.
+/// @details Calls of the environment API on the argument frame with a
+/// constant symbol key of the shape of type are replaced by slot accesses
+/// guarded by the shape, and an entry guard calling fallback is inserted
+/// for other types. Keys must be folded already.
+void specialize_function_for_type(llvm::Function &fn,
+                                  llvm::Function &fallback,
+                                  const TypeObject &type);
 } // namespace ljf::internal
 
 extern "C" {
@@ -106,10 +302,48 @@ ljf::FunctionId ljf_internal_register_llvm_function(llvm::Function *f,
 ljf::Object *ljf_internal_get_object_by_index(ljf::Object *obj, uint64_t index);
 void ljf_internal_set_object_by_index(ljf::Object *obj, uint64_t index,
                                       ljf::Object *value);
+/// @brief Collect cyclic garbage now.
+/// @return number of deleted objects
+uint64_t ljf_internal_collect_cycles();
+/// print hit/miss counters of all inline cache sites to stderr
+void ljf_internal_dump_inline_cache_stats();
 void ljf_internal_reserve_object_array_table_size(ljf::Object *obj,
                                                   uint64_t size);
 void ljf_internal_resize_object_array_table_size(ljf::Object *obj,
                                                  uint64_t size);
+
+// Called by code made by specialize_function_for_type().
+uint64_t ljf_internal_environment_type_id(ljf::Environment *env);
+/// @brief ljf_environment_get() using slot if env has shape.
+LJFHandle ljf_internal_environment_get_at(ljf::Context *ctx,
+                                          ljf::Environment *env, LJFHandle key,
+                                          LJFAttribute attr,
+                                          LJFHandle default_value,
+                                          const ljf::Shape *shape,
+                                          uint64_t slot);
+/// @brief ljf_environment_set() using slot if env has shape.
+void ljf_internal_environment_set_at(ljf::Context *ctx, ljf::Environment *env,
+                                     LJFHandle key, LJFHandle value,
+                                     LJFAttribute attr,
+                                     const ljf::Shape *shape, uint64_t slot);
+int64_t ljf_internal_environment_get_int64_at(
+    ljf::Context *ctx, ljf::Environment *env, LJFHandle key, LJFAttribute attr,
+    int64_t default_value, const ljf::Shape *shape, uint64_t slot);
+void ljf_internal_environment_set_int64_at(ljf::Context *ctx,
+                                           ljf::Environment *env,
+                                           LJFHandle key, int64_t value,
+                                           LJFAttribute attr,
+                                           const ljf::Shape *shape,
+                                           uint64_t slot);
+double ljf_internal_environment_get_double_at(
+    ljf::Context *ctx, ljf::Environment *env, LJFHandle key, LJFAttribute attr,
+    double default_value, const ljf::Shape *shape, uint64_t slot);
+void ljf_internal_environment_set_double_at(ljf::Context *ctx,
+                                            ljf::Environment *env,
+                                            LJFHandle key, double value,
+                                            LJFAttribute attr,
+                                            const ljf::Shape *shape,
+                                            uint64_t slot);
 }
 
 namespace ljf {
@@ -1,4 +1,5 @@
 
+#include <atomic>
 #include <dlfcn.h>
 #include <iostream>
 #include <string>
@@ -10,10 +11,15 @@
 #include <llvm/IR/Function.h>
 #include <llvm/IR/Module.h>
 
+#include "CompileQueue.hpp"
+#include "CycleCollector.hpp"
+#include "InlineCache.hpp"
 #include "Object.hpp"
 #include "ObjectIterator.hpp"
 #include "Roots.hpp"
+#include "Symbol.hpp"
 #include "TypeObject.hpp"
+#include "handle-conversion.hpp"
 #include "ljf-system-property.hpp"
 #include "ljf/ObjectWrapper.hpp"
 #include "ljf/initmsg.hpp"
@@ -40,15 +46,19 @@ static struct RuntimeLoadedOnceCheck {
     }
 } runtime_loaded_once_check;
 
-static size_t allocated_memory_size;
 struct Done {
 
     Done() = default;
 
     ~Done() {
         try {
-            std::cout << "LJF: allocated_memory_size: " << allocated_memory_size
-                      << std::endl;
+            ljf::dump_pool_statistics(std::cout);
+            ljf::dump_inline_cache_stats(std::cout, false);
+            if constexpr (ljf::config::cycle_collection) {
+                auto &collector = ljf::CycleCollector::global();
+                collector.stop_background_thread();
+                collector.dump_statistics(std::cout);
+            }
         } catch (...) {
             // nop
         }
@@ -59,66 +69,178 @@ static Done done;
 namespace ljf {
 struct FunctionData {
     // naive means 'not optimized'
-    const llvm::Function *naive_llvm_function;
-    llvm::Module *LLVMModule;
+    const llvm::Function *naive_llvm_function = nullptr;
+    llvm::Module *LLVMModule = nullptr;
 
-    FunctionPtr naive_function = nullptr;
+    // Function pointers are replaced while other threads call them when
+    // optimized code compiled in the background is ready.
+    std::atomic<FunctionPtr> naive_function = nullptr;
 
-    struct DataForArgType {
-        std::size_t called_count = 0;
+    // Set if the function receives arguments by ljf_call_function_fast().
+    std::atomic<FastFunctionPtr> fast_function = nullptr;
+    // Stored before fast_function is published and never changed after that,
+    // so it is valid if fast_function loaded by acquire is not null.
+    std::atomic<std::size_t> arity = 0;
 
-        // specialized function for argument types
-        llvm::Function *specialized_function = nullptr;
+    struct DataForArgType {
+        std::atomic<std::size_t> called_count = 0;
+        // Set by the specialization worker. The code is specialized to the
+        // argument type and falls back to naive_function for other types.
+        std::atomic<FunctionPtr> specialized_function = nullptr;
+        std::atomic<bool> specialization_requested = false;
     };
 
-    std::unordered_map<TypeObject, DataForArgType> data_for_arg_type;
+    // used if config::calculate_type is false
+    DataForArgType data_for_any_arg_type;
+
+    std::mutex data_for_arg_type_mutex;
+    // Elements are never erased, so references to them stay valid.
+    // TypeObject::id() of argument -> data
+    std::unordered_map<uint64_t, DataForArgType> data_for_arg_type;
 };
 
+/// @brief Append-only table of FunctionData indexed by FunctionId.
+/// @details Entries are stored in segments whose sizes double, so entries
+/// never move and get() is an index without locking even while other threads
+/// add functions. Adding is serialized by mutex_.
 class FunctionTable {
 private:
+    static constexpr std::size_t first_segment_size = 64;
+    // enough for all FunctionId
+    static constexpr std::size_t max_segments = 48;
+
     std::mutex mutex_;
-    std::size_t size_;
-    std::unordered_map<FunctionId, FunctionData> function_table_;
+    // number of published entries
+    std::atomic<std::size_t> size_ = 0;
+    std::atomic<FunctionData *> segments_[max_segments] = {};
+
+    /// @return pair of segment index and offset in the segment
+    static std::pair<std::size_t, std::size_t> locate(FunctionId id) {
+        // segment k starts at first_segment_size * (2^k - 1)
+        const std::size_t n = id / first_segment_size + 1;
+        const std::size_t segment = 63 - __builtin_clzll(n);
+        const std::size_t offset =
+            id - first_segment_size * ((std::size_t(1) << segment) - 1);
+        return {segment, offset};
+    }
 
-    FunctionId add(const FunctionData &f) {
+    FunctionData &at(FunctionId id) {
+        auto [segment, offset] = locate(id);
+        return segments_[segment].load(std::memory_order_acquire)[offset];
+    }
+
+    /// @param init function initializing FunctionData & of the new entry
+    template <typename Init> FunctionId add(Init &&init) {
         std::lock_guard lk{mutex_};
-        const auto id = size_;
-        size_++;
-        function_table_.insert_or_assign(id, f);
+        const auto id = size_.load(std::memory_order_relaxed);
+        auto [segment, offset] = locate(id);
+        if (segment >= max_segments) {
+            throw ljf::runtime_error("function table is full");
+        }
+        auto data = segments_[segment].load(std::memory_order_relaxed);
+        if (!data) {
+            data = new FunctionData[first_segment_size << segment]();
+            segments_[segment].store(data, std::memory_order_release);
+        }
+        init(data[offset]);
+        // publish the entry
+        size_.store(id + 1, std::memory_order_release);
         return id;
     }
 
 public:
     FunctionId add_native(FunctionPtr fn) {
-        return add({nullptr, nullptr, fn});
+        return add([&](FunctionData &data) { data.naive_function = fn; });
+    }
+
+    FunctionId add_native_fast(FastFunctionPtr fn, std::size_t arity) {
+        return add([&](FunctionData &data) {
+            data.arity.store(arity, std::memory_order_relaxed);
+            data.fast_function.store(fn, std::memory_order_relaxed);
+        });
     }
 
     FunctionId add_llvm(llvm::Function *fn, llvm::Module *module,
                         FunctionPtr fn_ptr) {
-        return add({fn, module, fn_ptr});
+        return add([&](FunctionData &data) {
+            data.naive_llvm_function = fn;
+            data.LLVMModule = module;
+            data.naive_function = fn_ptr;
+        });
+    }
+
+    FunctionTable() = default;
+    FunctionTable(const FunctionTable &) = delete;
+    FunctionTable &operator=(const FunctionTable &) = delete;
+
+    ~FunctionTable() {
+        for (auto &segment : segments_) {
+            delete[] segment.load(std::memory_order_relaxed);
+        }
     }
 
     void set_native(FunctionId id, FunctionPtr fn) {
         std::lock_guard lk{mutex_};
-        try {
-            function_table_.at(id).naive_function = fn;
-        } catch (const std::out_of_range &) {
+        if (id >= size_.load(std::memory_order_relaxed)) {
             throw ljf::runtime_error(
                 "error: set function to invalid function id");
         }
+        at(id).naive_function.store(fn, std::memory_order_release);
+    }
+
+    void set_fast(FunctionId id, FastFunctionPtr fn, std::size_t arity) {
+        std::lock_guard lk{mutex_};
+        if (id >= size_.load(std::memory_order_relaxed)) {
+            throw ljf::runtime_error(
+                "error: set function to invalid function id");
+        }
+        auto &data = at(id);
+        if (data.fast_function.load(std::memory_order_relaxed)) {
+            // Callers may be reading the arity of the old function.
+            if (data.arity.load(std::memory_order_relaxed) != arity) {
+                throw ljf::runtime_error("fast function: arity changed");
+            }
+        } else {
+            data.arity.store(arity, std::memory_order_relaxed);
+        }
+        data.fast_function.store(fn, std::memory_order_release);
     }
 
     FunctionData &get(FunctionId id) {
-        try {
-            return function_table_.at(id);
-        } catch (std::out_of_range) {
+        if (id >= size_.load(std::memory_order_acquire)) {
             throw ljf::runtime_error("no such function id");
         }
+        return at(id);
     }
 };
 
 namespace {
     FunctionTable function_table;
+
+    /// @brief Compile code of func_data specialized to arg_type in the
+    /// background, and dispatch calls with arg_type to it when done.
+    /// Only the first request for data compiles.
+    void request_specialization(FunctionData &func_data,
+                                FunctionData::DataForArgType &data,
+                                const TypeObject *arg_type) {
+        if (data.specialization_requested.exchange(true,
+                                                   std::memory_order_relaxed)) {
+            return;
+        }
+        auto fn = func_data.naive_llvm_function;
+        // TypeObjects live until the process exits.
+        CompileQueue::global().submit([fn, &data, arg_type] {
+            try {
+                data.specialized_function.store(
+                    internal::compile_specialized_function(*fn, *arg_type),
+                    std::memory_order_release);
+            } catch (const std::exception &e) {
+                // Calls continue to go to the naive function.
+                std::cerr << "ljf: specialization of " << fn->getName().str()
+                          << " failed: " << e.what() << std::endl;
+            }
+        });
+    }
 } // namespace
 
 // Roots
@@ -153,62 +275,108 @@ namespace ljf::internal {
 ObjectHolder create_environment_with_argument(Context *ctx, LJFHandle arg_h) {
 
     auto env = ctx->get_from_handle(ljf_new(ctx));
-
-    auto env_maps = ctx->get_from_handle(ljf_new(ctx));
-    set_object_to_hidden_table(env, "ljf.env.maps", env_maps);
     if (arg_h != ljf_internal_null_handle) {
         auto arg = ctx->get_from_handle(arg_h);
-        auto local_env = ctx->get_from_handle(ljf_new(ctx));
-        local_env->swap(*arg);
+        env->swap(*arg);
         // arg is now empty
-
-        // set maps[0]
-        env_maps->array_push(local_env);
     }
+    env->make_environment(ljf_internal_nullptr);
     return env;
 }
 
-ObjectHolder create_environment(Context *ctx,
-                                bool prepare_0th_frame /*=true*/) {
-
-    if (prepare_0th_frame) {
-        auto arg = ljf_new(ctx);
-        return create_environment_with_argument(ctx, arg);
-    } else {
-        return create_environment_with_argument(ctx, ljf_internal_null_handle);
-    }
+ObjectHolder create_environment(Context *ctx) {
+    return create_environment_with_argument(ctx, ljf_internal_null_handle);
 }
 
 ObjectHolder create_callee_environment(Environment *parent, Object *arg) {
     auto ctx = internal::make_temporary_context();
     // Prepare callee local env and set arguments into the local env.
-    auto callee_env = internal::create_environment(ctx.get(), arg);
-    auto callee_env_maps =
-        get_object_from_hidden_table(callee_env.get(), "ljf.env.maps");
+    auto arg_h = arg ? ctx->register_temporary_object(arg)
+                     : ljf_internal_null_handle;
+    auto callee_env = create_environment_with_argument(ctx.get(), arg_h);
+    // Parent frames are shared, not copied.
+    callee_env->make_environment(parent);
+    return callee_env;
+}
+
+} // namespace ljf::internal
+
+namespace {
+using namespace ljf::internal;
 
-    if (!parent) {
-        return callee_env;
+void check_environment(Environment *env) {
+    if (!env->is_environment()) {
+        throw ljf::runtime_error("not an Environment");
     }
+}
+
+/// @return the frame of depth, 0 is env itself.
+Environment *environment_frame_at(Environment *env, size_t depth) {
+    check_environment(env);
+    for (size_t i = 0; i < depth; i++) {
+        env = env->environment_parent();
+        if (!env) {
+            throw std::out_of_range("environment depth out of range");
+        }
+    }
+    return env;
+}
 
-    auto parent_env_maps = get_object_from_hidden_table(parent, "ljf.env.maps");
+template <typename T>
+T environment_get_unboxed(Context *ctx, Environment *env, LJFHandle key,
+                          LJFAttribute attr, T default_value) {
+    check_environment(env);
 
-    if (!parent_env_maps) {
-        return callee_env;
+    auto key_ptr = ctx->get_key_from_handle(key, attr);
+    for (auto frame = env; frame; frame = frame->environment_parent()) {
+        auto value = frame->get_unboxed(key_ptr, attr);
+        if (!value) {
+            continue;
+        }
+        return unboxed_value_as<T>(*value);
     }
 
-    // set maps[1:]
-    // parent_env_maps->dump();
-    for (size_t i = 0; i < parent_env_maps->array_size(); i++) {
-        // std::cout << "i: " << i << "\n";
-        Object *map = parent_env_maps->array_at(i);
-        assert(map);
-        callee_env_maps->array_push(map);
+    return default_value;
+}
+
+void check_fast_call_arity(std::size_t arity) {
+    if (arity > max_fast_call_arity) {
+        throw ljf::runtime_error("fast function: too many parameters");
     }
+}
 
-    return callee_env;
+/// @brief Call fast function of func_data in a new context on the stack.
+/// args are handles of caller_ctx.
+LJFHandle call_fast_function(Context *caller_ctx, const FunctionData &func_data,
+                             Environment *env, const LJFHandle *args) {
+    ObjectHolder ret_obj;
+    {
+        Context ctx{func_data.LLVMModule, caller_ctx};
+
+        thread_local_root->set_top_context(&ctx);
+        auto finally_restore_ctx = llvm::make_scope_exit(
+            [&caller_ctx] { thread_local_root->set_top_context(caller_ctx); });
+
+        auto fast_function =
+            func_data.fast_function.load(std::memory_order_acquire);
+        auto ret = fast_function(&ctx, env, args);
+        if (ljf_is_fixnum(ret)) {
+            return ret;
+        }
+        ret_obj = ctx.get_from_handle(ret);
+    }
+    // Registered after ctx is released, so that caller_ctx pushes to the
+    // handle arena instead of its overflow.
+    return caller_ctx->register_temporary_object(ret_obj.get());
 }
 
-} // namespace ljf::internal
+void environment_set_value(Context *ctx, Environment *env, LJFHandle key,
+                           const Object::ValueType &value,
+                           LJFAttribute attr) {
+    check_environment(env);
+    env->set_value(ctx->get_key_from_handle(key, attr), value, attr);
+}
+} // namespace
 
 extern "C" {
 using namespace ljf::internal;
@@ -217,39 +385,78 @@ void ljf_internal_set_native_function(FunctionId id, FunctionPtr fn) {
     function_table.set_native(id, fn);
 }
 
-/**************** table API ***************/
-LJFHandle ljf_get(ljf::Context *ctx, LJFHandle obj, LJFHandle key,
-                  LJFAttribute attr, LJFHandle default_value) {
+void ljf_internal_set_fast_function(FunctionId id, FastFunctionPtr fn,
+                                    uint64_t arity) {
+    check_fast_call_arity(arity);
+    function_table.set_fast(id, fn, arity);
+}
 
-    auto key_ptr = [&]() -> const void * {
-        if (AttributeTraits::mask(attr, LJF_ATTR_KEY_TYPE_MASK) ==
-            LJF_ATTR_C_STR_KEY) {
-            return reinterpret_cast<const void *>(key);
-        } else {
-            // assert((attr & LJF_ATTR_KEY_TYPE_MASK) == C_STR_KEY)
-            return ctx->get_from_handle(obj);
-        }
-    }();
-    auto ret = ctx->get_from_handle(obj)->get(key_ptr, attr);
-    if (ret == IncrementedObjectPtr::NULL_PTR) {
-        return default_value;
+uint64_t ljf_internal_environment_type_id(Environment *env) {
+    check_environment(env);
+    return env->calculate_type()->id();
+}
+
+LJFHandle ljf_internal_environment_get_at(Context *ctx, Environment *env,
+                                          LJFHandle key, LJFAttribute attr,
+                                          LJFHandle default_value,
+                                          const Shape *shape, uint64_t slot) {
+    if (auto value = env->get_value_if_shape(shape, slot)) {
+        return handle_from_value(ctx, value, default_value);
     }
-    return ctx->register_temporary_object(std::move(ret));
+    return ljf_environment_get(ctx, env, key, attr, default_value);
 }
 
-void ljf_set(Context *ctx, LJFHandle obj, LJFHandle key_handle_or_cstr,
-             LJFHandle value, LJFAttribute attr) {
-    assert(AttributeTraits::mask(attr, LJF_ATTR_DATA_TYPE_MASK) ==
-           LJF_ATTR_BOXED_OBJECT);
-    auto key = [&]() -> void * {
-        if (AttributeTraits::mask(attr, LJF_ATTR_KEY_TYPE_MASK) ==
-            LJF_ATTR_C_STR_KEY) {
-            return reinterpret_cast<void *>(key_handle_or_cstr);
-        } else {
-            return ctx->get_from_handle(key_handle_or_cstr);
-        }
-    }();
-    ctx->get_from_handle(obj)->set(key, ctx->get_from_handle(value), attr);
+void ljf_internal_environment_set_at(Context *ctx, Environment *env,
+                                     LJFHandle key, LJFHandle value,
+                                     LJFAttribute attr, const Shape *shape,
+                                     uint64_t slot) {
+    if (!env->set_value_if_shape(shape, slot,
+                                 value_from_handle(ctx, value, attr))) {
+        ljf_environment_set(ctx, env, key, value, attr);
+    }
+}
+
+int64_t ljf_internal_environment_get_int64_at(Context *ctx, Environment *env,
+                                              LJFHandle key, LJFAttribute attr,
+                                              int64_t default_value,
+                                              const Shape *shape,
+                                              uint64_t slot) {
+    if (auto value = env->get_unboxed_if_shape(shape, slot)) {
+        return unboxed_value_as<int64_t>(*value);
+    }
+    return environment_get_unboxed(ctx, env, key, attr, default_value);
+}
+
+void ljf_internal_environment_set_int64_at(Context *ctx, Environment *env,
+                                           LJFHandle key, int64_t value,
+                                           LJFAttribute attr,
+                                           const Shape *shape, uint64_t slot) {
+    auto value_obj = Object::ValueType::from_int64(attr, value);
+    if (!env->set_value_if_shape(shape, slot, value_obj)) {
+        environment_set_value(ctx, env, key, value_obj, attr);
+    }
+}
+
+double ljf_internal_environment_get_double_at(Context *ctx, Environment *env,
+                                              LJFHandle key, LJFAttribute attr,
+                                              double default_value,
+                                              const Shape *shape,
+                                              uint64_t slot) {
+    if (auto value = env->get_unboxed_if_shape(shape, slot)) {
+        return unboxed_value_as<double>(*value);
+    }
+    return environment_get_unboxed(ctx, env, key, attr, default_value);
+}
+
+void ljf_internal_environment_set_double_at(Context *ctx, Environment *env,
+                                            LJFHandle key, double value,
+                                            LJFAttribute attr,
+                                            const Shape *shape,
+                                            uint64_t slot) {
+    auto value_obj = Object::ValueType::from_double(attr, value);
+    if (!env->set_value_if_shape(shape, slot, value_obj)) {
+        environment_set_value(ctx, env, key, value_obj, attr);
+    }
 }
 
 /**************** array API ***************/
@@ -261,7 +468,12 @@ LJFHandle ljf_array_get(Context *ctx, LJFHandle obj_h, size_t index) {
         throw std::out_of_range("ljf_array_get");
     }
 
-    return ctx->register_temporary_object(obj->array_at(index));
+    auto value = obj->array_value_at(index);
+    if (value.is_object() && value.as_object() == ljf_internal_nullptr) {
+        // uninitialized element
+        return ctx->register_temporary_object(ljf_internal_nullptr);
+    }
+    return handle_from_value(ctx, value, ljf_internal_null_handle);
 }
 
 void ljf_array_set(Object *obj, size_t index, Object *value) {
@@ -271,12 +483,8 @@ void ljf_array_set(Object *obj, size_t index, Object *value) {
 
 void ljf_array_push(Context *ctx, LJFHandle obj, LJFHandle value) {
     auto obj_raw = ctx->get_from_handle(obj);
-    auto value_raw = ctx->get_from_handle(value);
-    obj_raw->array_push(value_raw);
-}
-
-size_t ljf_array_size(Context *ctx, LJFHandle obj_h) {
-    return ctx->get_from_handle(obj_h)->array_size();
+    obj_raw->array_push_value(
+        value_from_handle(ctx, value, LJF_ATTR_DEFAULT));
 }
 
 //*********************//
@@ -314,64 +522,121 @@ LJFHandle ljf_call_function(Context *caller_ctx, FunctionId function_id,
     auto &func_data = function_table.get(function_id);
     // std::cout << func_data.naive_llvm_function->getName().str() << "\n";
 
+    if (!func_data.naive_function &&
+        func_data.fast_function.load(std::memory_order_acquire)) {
+        // Pass elements of the argument array.
+        LJFHandle args[max_fast_call_arity];
+        auto argc = arg == ljf_internal_null_handle
+                        ? 0
+                        : ljf_array_size(caller_ctx, arg);
+        if (argc != func_data.arity.load(std::memory_order_relaxed)) {
+            throw ljf::runtime_error("fast function: arity mismatch");
+        }
+        for (size_t i = 0; i < argc; i++) {
+            args[i] = ljf_array_get(caller_ctx, arg, i);
+        }
+        return call_fast_function(caller_ctx, func_data,
+                                  caller_ctx->get_from_handle(env), args);
+    }
+
     auto callee_env = create_callee_environment(
         caller_ctx->get_from_handle(env), caller_ctx->get_from_handle(arg));
 
-    auto arg_type = callee_env->calculate_type();
+    auto data_for_arg_type = &func_data.data_for_any_arg_type;
+    const TypeObject *arg_type = nullptr;
+    if constexpr (config::calculate_type) {
+        // O(1), the type is kept up to date by the object.
+        arg_type = callee_env->calculate_type();
+        std::lock_guard lk{func_data.data_for_arg_type_mutex};
+        data_for_arg_type = &func_data.data_for_arg_type[arg_type->id()];
+    }
+    const auto called_count = data_for_arg_type->called_count.fetch_add(
+                                  1, std::memory_order_relaxed) +
+                              1;
+
+    FunctionPtr func_ptr =
+        func_data.naive_function.load(std::memory_order_acquire);
+    if (auto specialized = data_for_arg_type->specialized_function.load(
+            std::memory_order_acquire)) {
+        func_ptr = specialized;
+    } else if (config::specialization_threshold != 0 && arg_type &&
+               func_data.naive_llvm_function &&
+               called_count == config::specialization_threshold) {
+        request_specialization(func_data, *data_for_arg_type, arg_type);
+    }
+    ObjectHolder ret_obj;
+    {
+        Context ctx{func_data.LLVMModule, caller_ctx};
 
-    auto &data_for_arg_type = func_data.data_for_arg_type[*arg_type];
-    data_for_arg_type.called_count++;
+        thread_local_root->set_top_context(&ctx);
+        auto finally_restore_ctx = llvm::make_scope_exit(
+            [&caller_ctx] { thread_local_root->set_top_context(caller_ctx); });
 
-    FunctionPtr func_ptr = func_data.naive_function;
-    Context ctx{func_data.LLVMModule, caller_ctx};
+        auto ret = func_ptr(&ctx, callee_env.get());
 
-    thread_local_root->set_top_context(&ctx);
-    auto finally_restore_ctx = llvm::make_scope_exit(
-        [&caller_ctx] { thread_local_root->set_top_context(caller_ctx); });
+        // std::cout << "END " << func_data.naive_llvm_function->getName().str()
+        // << "\n";
 
-    auto ret = func_ptr(&ctx, callee_env.get());
+        if (ljf_is_fixnum(ret)) {
+            return ret;
+        }
+        ret_obj = ctx.get_from_handle(ret);
+    }
+    // Registered after ctx is released, so that caller_ctx pushes to the
+    // handle arena instead of its overflow.
+    return caller_ctx->register_temporary_object(ret_obj.get());
+}
 
-    // std::cout << "END " << func_data.naive_llvm_function->getName().str() <<
-    // "\n";
+LJFHandle ljf_call_function_fast(Context *caller_ctx, FunctionId function_id,
+                                 LJFHandle env, const LJFHandle *args,
+                                 size_t argc) {
+    auto &func_data = function_table.get(function_id);
+    if (func_data.fast_function.load(std::memory_order_acquire) &&
+        func_data.arity.load(std::memory_order_relaxed) == argc) {
+        auto env_obj = env == ljf_internal_null_handle
+                           ? ljf_internal_nullptr
+                           : caller_ctx->get_from_handle(env);
+        return call_fast_function(caller_ctx, func_data, env_obj, args);
+    }
 
-    auto ret_raw = ctx.get_from_handle(ret);
-    return caller_ctx->register_temporary_object(ret_raw);
+    auto arg = ljf_new(caller_ctx);
+    for (size_t i = 0; i < argc; i++) {
+        ljf_array_push(caller_ctx, arg, args[i]);
+    }
+    return ljf_call_function(caller_ctx, function_id, env, arg);
 }
 
 LJFHandle ljf_new_with_native_data(Context *ctx, native_data_t data) {
+    if constexpr (config::cycle_collection) {
+        // Allocation is a safepoint: compiled code holds objects by handles
+        // only.
+        auto &collector = CycleCollector::global();
+        if (collector.collection_requested()) {
+            if constexpr (config::concurrent_cycle_collection) {
+                collector.request_background_collection();
+            } else {
+                collector.collect();
+            }
+        }
+    }
     Object *obj = new Object(data);
-    allocated_memory_size += sizeof(Object);
     return ctx->register_temporary_object(obj);
 }
 
 LJFHandle ljf_new(Context *ctx) { return ljf_new_with_native_data(ctx, 0); }
 
-uint64_t ljf_get_native_data(const Object *obj) {
-
-    return obj->get_native_data();
-}
-
 LJFHandle ljf_environment_get(ljf::Context *ctx, Environment *env,
                               LJFHandle key_handle, LJFAttribute attr,
                               LJFHandle default_value) {
-
-    auto maps = get_object_from_hidden_table(env, "ljf.env.maps");
-
-    if (!maps) {
-        throw ljf::runtime_error(
-            "ljf_get_object_from_environment: not an Environment");
-    }
+    check_environment(env);
 
     auto key = ctx->get_key_from_handle(key_handle, attr);
-    for (size_t i = 0; i < maps->array_size(); i++) {
-        // env object is nested.
-        // maps->array_at(0) is most inner environment.
-        auto env_i = maps->array_at(i);
-        auto obj = env_i->get(key, attr);
-        if (obj == IncrementedObjectPtr::NULL_PTR) {
+    for (auto frame = env; frame; frame = frame->environment_parent()) {
+        auto value = frame->get_value(key, attr);
+        if (!value) {
             continue;
         }
-        return ctx->register_temporary_object(std::move(obj));
+        return handle_from_value(ctx, value, default_value);
     }
 
     return default_value;
@@ -379,23 +644,89 @@ LJFHandle ljf_environment_get(ljf::Context *ctx, Environment *env,
 
 void ljf_environment_set(ljf::Context *ctx, Environment *env, LJFHandle key,
                          LJFHandle value, LJFAttribute attr) {
+    environment_set_value(ctx, env, key, value_from_handle(ctx, value, attr),
+                          attr);
+}
 
-    auto maps = get_object_from_hidden_table(env, "ljf.env.maps");
+bool ljf_environment_resolve(ljf::Context *ctx, Environment *env,
+                             LJFHandle key_handle, LJFAttribute attr,
+                             uint64_t *depth, uint64_t *slot,
+                             uint64_t *shape) {
+    check_environment(env);
 
-    if (!maps) {
-        throw ljf::runtime_error(
-            "ljf_get_object_from_environment: not a Environment");
+    auto key = ctx->get_key_from_handle(key_handle, attr);
+    uint64_t d = 0;
+    for (auto frame = env; frame; frame = frame->environment_parent(), d++) {
+        const Shape *frame_shape;
+        if (auto s = frame->find_slot(key, attr, &frame_shape)) {
+            *depth = d;
+            *slot = *s;
+            *shape = reinterpret_cast<uint64_t>(frame_shape);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ljf_environment_get_slot(ljf::Context *ctx, Environment *env,
+                              uint64_t depth, uint64_t slot, uint64_t shape,
+                              LJFHandle *value) {
+    auto frame = environment_frame_at(env, depth);
+    if (!shape) {
+        return false;
+    }
+    auto frame_value =
+        frame->get_value_if_shape(reinterpret_cast<const Shape *>(shape), slot);
+    if (!frame_value) {
+        return false;
     }
+    *value = handle_from_value(ctx, frame_value, ljf_internal_null_handle);
+    return true;
+}
+
+bool ljf_environment_set_slot(ljf::Context *ctx, Environment *env,
+                              uint64_t depth, uint64_t slot, uint64_t shape,
+                              LJFHandle value, LJFAttribute attr) {
+    auto frame = environment_frame_at(env, depth);
+    return shape && frame->set_value_if_shape(
+                        reinterpret_cast<const Shape *>(shape), slot,
+                        value_from_handle(ctx, value, attr));
+}
+
+int64_t ljf_environment_get_int64(Context *ctx, Environment *env,
+                                  LJFHandle key, LJFAttribute attr,
+                                  int64_t default_value) {
+    return environment_get_unboxed(ctx, env, key, attr, default_value);
+}
+
+void ljf_environment_set_int64(Context *ctx, Environment *env, LJFHandle key,
+                               int64_t value, LJFAttribute attr) {
+    environment_set_value(ctx, env, key,
+                            Object::ValueType::from_int64(attr, value), attr);
+}
+
+double ljf_environment_get_double(Context *ctx, Environment *env,
+                                  LJFHandle key, LJFAttribute attr,
+                                  double default_value) {
+    return environment_get_unboxed(ctx, env, key, attr, default_value);
+}
 
-    auto map0 = maps->array_at(0);
-    map0->set(ctx->get_key_from_handle(key, attr), ctx->get_from_handle(value),
-              attr);
+void ljf_environment_set_double(Context *ctx, Environment *env, LJFHandle key,
+                                double value, LJFAttribute attr) {
+    environment_set_value(ctx, env, key,
+                            Object::ValueType::from_double(attr, value), attr);
 }
 
 FunctionId ljf_register_native_function(FunctionPtr fn) {
     return function_table.add_native(fn);
 }
 
+FunctionId ljf_register_native_fast_function(FastFunctionPtr fn,
+                                             size_t arity) {
+    check_fast_call_arity(arity);
+    return function_table.add_native_fast(fn, arity);
+}
+
 FunctionId ljf_register_llvm_function(Context *ctx, const char *function_name,
                                       FunctionPtr fn_ptr) {
     auto LLVMModule = ctx->get_llvm_module();
@@ -419,6 +750,10 @@ LJFHandle ljf_wrap_c_str(Context *ctx, const char *str) {
     // return wrapper.get();
 }
 
+LJFHandle ljf_intern_symbol(const char *str) {
+    return reinterpret_cast<LJFHandle>(Symbol::intern(str));
+}
+
 /// return: returned object of module_main()
 /// out: env: environment of module
 static Object *load_source_code(const char *language, const char *source_path,
@@ -461,6 +796,18 @@ FunctionId ljf_internal_register_llvm_function(llvm::Function *f,
 //     obj->array_table_set_index(index, value);
 // }
 
+uint64_t ljf_internal_collect_cycles() {
+    auto &collector = CycleCollector::global();
+    if constexpr (config::concurrent_cycle_collection) {
+        return collector.collect_concurrently().collected_objects;
+    }
+    return collector.collect().collected_objects;
+}
+
+void ljf_internal_dump_inline_cache_stats() {
+    dump_inline_cache_stats(std::cerr, true);
+}
+
 void ljf_internal_reserve_object_array_table_size(Object *obj, uint64_t size) {
     obj->array_table_reserve(size);
 }
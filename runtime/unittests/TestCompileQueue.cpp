@@ -0,0 +1,38 @@
+#include "../CompileQueue.hpp"
+#include "gtest/gtest.h"
+
+#include <atomic>
+
+using namespace ljf;
+
+TEST(CompileQueue, RunsAllTasks) {
+    CompileQueue queue{4};
+    std::atomic<int> count = 0;
+    for (int i = 0; i < 100; i++) {
+        queue.submit([&count] { count++; });
+    }
+    queue.wait_idle();
+    EXPECT_EQ(100, count);
+}
+
+TEST(CompileQueue, TasksRunInBackground) {
+    CompileQueue queue{1};
+    std::mutex mutex;
+    std::unique_lock lk{mutex};
+    std::atomic<bool> done = false;
+
+    // The task waits for this thread, so it must run on another thread.
+    queue.submit([&] {
+        std::lock_guard task_lk{mutex};
+        done = true;
+    });
+    EXPECT_FALSE(done);
+    lk.unlock();
+    queue.wait_idle();
+    EXPECT_TRUE(done);
+}
+
+TEST(CompileQueue, WaitIdleWithoutTasks) {
+    CompileQueue queue{2};
+    queue.wait_idle();
+}
@@ -0,0 +1,130 @@
+#include "../Object.hpp"
+#include "../runtime-internal.hpp"
+#include "gtest/gtest.h"
+
+#include <future>
+#include <thread>
+
+using namespace ljf;
+using namespace ljf::internal;
+
+TEST(Context, HeldObjectSurvivesContext) {
+    ObjectHolder holder;
+    {
+        auto ctx = make_temporary_context();
+        auto h = ljf_new_with_native_data(ctx.get(), 42);
+        holder = ctx->get_from_handle(h);
+    }
+    EXPECT_EQ(42, holder->get_native_data());
+}
+
+TEST(Context, ObjectMovedToOlderContextSurvivesYoungerContext) {
+    auto outer = make_temporary_context();
+    LJFHandle outer_handle;
+    {
+        auto inner = make_temporary_context();
+        auto h = ljf_new_with_native_data(inner.get(), 42);
+        outer_handle =
+            outer->register_temporary_object(inner->get_from_handle(h));
+    }
+    EXPECT_EQ(42, outer->get_from_handle(outer_handle)->get_native_data());
+}
+
+TEST(Context, ObjectRemovedFromTableSurvivesWhileHandled) {
+    auto ctx = make_temporary_context();
+    auto obj = ljf_new(ctx.get());
+    auto value = ljf_new_with_native_data(ctx.get(), 42);
+    auto attr = AttributeTraits::or_attr(LJF_ATTR_VISIBLE, LJF_ATTR_C_STR_KEY);
+
+    ljf_set(ctx.get(), obj, cast_to_ljf_handle("x"), value, attr);
+    // refcount of value becomes 0 but ctx still refers it
+    ljf_set(ctx.get(), obj, cast_to_ljf_handle("x"), ljf_new(ctx.get()), attr);
+
+    EXPECT_EQ(42, ctx->get_from_handle(value)->get_native_data());
+}
+
+TEST(Context, ObjectOwnedByOtherThreadIsCounted) {
+    auto ctx = make_temporary_context();
+    auto h = ljf_new_with_native_data(ctx.get(), 42);
+    Object *obj = ctx->get_from_handle(h);
+
+    std::promise<void> registered;
+    std::promise<void> released;
+    native_data_t data = 0;
+    std::thread th([&] {
+        auto other_ctx = make_temporary_context();
+        auto other_handle = other_ctx->register_temporary_object(obj);
+        registered.set_value();
+        released.get_future().wait();
+        data = other_ctx->get_from_handle(other_handle)->get_native_data();
+    });
+    registered.get_future().wait();
+    ctx.reset();
+    released.set_value();
+    th.join();
+
+    EXPECT_EQ(42, data);
+}
+
+TEST(Context, ObjectOwnedByThisThreadSurvivesOwnerOfOtherThread) {
+    std::promise<Object *> created;
+    std::promise<void> registered;
+    std::thread th([&] {
+        auto other_ctx = make_temporary_context();
+        auto h = ljf_new_with_native_data(other_ctx.get(), 42);
+        created.set_value(other_ctx->get_from_handle(h));
+        registered.get_future().wait();
+        // other_ctx is released here
+    });
+
+    auto ctx = make_temporary_context();
+    auto h = ctx->register_temporary_object(created.get_future().get());
+    registered.set_value();
+    th.join();
+
+    EXPECT_EQ(42, ctx->get_from_handle(h)->get_native_data());
+}
+
+TEST(Context, ManyHandlesInNestedContexts) {
+    auto outer = make_temporary_context();
+    auto outer_handle = ljf_new_with_native_data(outer.get(), 42);
+    for (size_t i = 0; i < 3; i++) {
+        auto inner = make_temporary_context();
+        for (size_t j = 0; j < 5000; j++) {
+            ljf_new(inner.get());
+        }
+        // outer is not the top context, so its handle doesn't use arena
+        outer->register_temporary_object(
+            inner->get_from_handle(ljf_new(inner.get())));
+    }
+    EXPECT_EQ(42, outer->get_from_handle(outer_handle)->get_native_data());
+}
+
+TEST(Context, OlderContextReleasedFirstHandsOverHandles) {
+    auto outer = make_temporary_context();
+    auto owned = ljf_new_with_native_data(outer.get(), 42);
+    auto inner = make_temporary_context();
+    // owned by outer, so inner doesn't count it.
+    auto inner_handle =
+        inner->register_temporary_object(outer->get_from_handle(owned));
+    // outer is not the top context, so this goes to its overflow.
+    auto overflowed = outer->register_temporary_object(
+        inner->get_from_handle(ljf_new_with_native_data(inner.get(), 43)));
+    ASSERT_TRUE(outer->has_overflow());
+    ObjectHolder holder = outer->get_from_handle(overflowed);
+
+    outer.reset();
+    EXPECT_EQ(42, inner->get_from_handle(inner_handle)->get_native_data());
+
+    // inner is the top context and pushes to the arena.
+    auto h = ljf_new_with_native_data(inner.get(), 44);
+    EXPECT_EQ(44, inner->get_from_handle(h)->get_native_data());
+    inner.reset();
+
+    // Contexts created later see a consistent arena.
+    auto next = make_temporary_context();
+    auto next_handle = ljf_new_with_native_data(next.get(), 45);
+    EXPECT_EQ(45, next->get_from_handle(next_handle)->get_native_data());
+    EXPECT_FALSE(next->has_overflow());
+    EXPECT_EQ(43, holder->get_native_data());
+}
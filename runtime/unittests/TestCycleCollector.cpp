@@ -0,0 +1,185 @@
+#include "../CycleCollector.hpp"
+#include "../Object.hpp"
+#include "../ObjectIterator.hpp"
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <thread>
+
+using namespace ljf;
+using namespace ljf::internal;
+
+namespace {
+ObjectHolder get_from_table(Object *obj, const char *key) {
+    return obj->get(const_cast<char *>(key),
+                    AttributeTraits::or_attr(LJF_ATTR_VISIBLE,
+                                             LJF_ATTR_C_STR_KEY));
+}
+} // namespace
+
+TEST(CycleCollector, CollectsGarbageCycle) {
+    auto &collector = CycleCollector::global();
+    // Collect cycles left by other tests.
+    collector.collect();
+
+    {
+        ObjectHolder a = make_new_held_object();
+        ObjectHolder b = make_new_held_object();
+        set_object_to_table(a.get(), "b", b.get());
+        set_object_to_table(b.get(), "a", a.get());
+    }
+
+    auto stats = collector.collect();
+    EXPECT_EQ(2u, stats.collected_objects);
+    EXPECT_EQ(0u, collector.collect().collected_objects);
+}
+
+TEST(CycleCollector, KeepsReachableCycle) {
+    auto &collector = CycleCollector::global();
+    ObjectHolder a = make_new_held_object();
+    {
+        ObjectHolder b = make_new_held_object();
+        ObjectHolder c = make_new_held_object();
+        set_object_to_table(a.get(), "b", b.get());
+        set_object_to_table(b.get(), "c", c.get());
+        set_object_to_table(c.get(), "b", b.get());
+    }
+
+    collector.collect();
+
+    auto b = get_from_table(a.get(), "b");
+    ASSERT_TRUE(b);
+    auto c = get_from_table(b.get(), "c");
+    ASSERT_TRUE(c);
+    EXPECT_EQ(b, get_from_table(c.get(), "b"));
+}
+
+TEST(CycleCollector, CollectsEnvironmentCycle) {
+    auto &collector = CycleCollector::global();
+    collector.collect();
+
+    {
+        // A closure environment referred by its parent environment.
+        ObjectHolder env = make_new_held_object();
+        ObjectHolder closure_env = make_new_held_object();
+        env->make_environment(nullptr);
+        closure_env->make_environment(env.get());
+        set_object_to_table(env.get(), "closure", closure_env.get());
+    }
+
+    EXPECT_EQ(2u, collector.collect().collected_objects);
+}
+
+TEST(CycleCollector, ConcurrentlyCollectsGarbageCycles) {
+    auto &collector = CycleCollector::global();
+    collector.collect();
+
+    for (int i = 0; i < 100; i++) {
+        ObjectHolder a = make_new_held_object();
+        ObjectHolder b = make_new_held_object();
+        set_object_to_table(a.get(), "b", b.get());
+        set_object_to_table(b.get(), "a", a.get());
+    }
+
+    auto stats = collector.collect_concurrently();
+    EXPECT_EQ(200u, stats.collected_objects);
+    EXPECT_GE(stats.pauses, 1u);
+    EXPECT_EQ(0u, collector.collect_concurrently().collected_objects);
+}
+
+TEST(CycleCollector, ConcurrentlyCollectsWhileMutatorRuns) {
+    auto &collector = CycleCollector::global();
+    ObjectHolder root = make_new_held_object();
+    std::atomic<bool> done = false;
+    std::atomic<int> iterations = 0;
+
+    // The mutator replaces a reachable cycle while the collector runs.
+    std::thread mutator([&root, &done, &iterations] {
+        while (!done) {
+            ObjectHolder a = make_new_held_object();
+            ObjectHolder b = make_new_held_object();
+            set_object_to_table(a.get(), "b", b.get());
+            set_object_to_table(b.get(), "a", a.get());
+            set_object_to_table(root.get(), "a", a.get());
+            ++iterations;
+        }
+    });
+    while (iterations < 1000) {
+        collector.collect_concurrently();
+    }
+    done = true;
+    mutator.join();
+
+    auto a = get_from_table(root.get(), "a");
+    ASSERT_TRUE(a);
+    auto b = get_from_table(a.get(), "b");
+    ASSERT_TRUE(b);
+    EXPECT_EQ(a, get_from_table(b.get(), "a"));
+}
+
+TEST(CycleCollector, CollectsWhileMutatorBoxesValues) {
+    auto &collector = CycleCollector::global();
+    ObjectHolder array = make_new_held_object();
+    for (int i = 0; i < 16; i++) {
+        array->array_push_value(
+            Object::ValueType::from_int64(LJF_ATTR_DEFAULT, i));
+    }
+    std::atomic<bool> done = false;
+    std::atomic<int> iterations = 0;
+
+    // Boxing locks a new object, which the collector may have locked.
+    std::thread mutator([&array, &done, &iterations] {
+        while (!done) {
+            for (uint64_t i = 0; i < 16; i++) {
+                ObjectHolder boxed = array->array_at(i);
+            }
+            for (auto it = array->iter_array(); it; it = it.next()) {
+                ObjectHolder boxed = it.get();
+            }
+            ++iterations;
+        }
+    });
+    while (iterations < 1000) {
+        collector.collect();
+    }
+    done = true;
+    mutator.join();
+
+    EXPECT_TRUE(array->array_at(0));
+}
+
+TEST(CycleCollector, CollectsCycleOfExitedThread) {
+    auto &collector = CycleCollector::global();
+    collector.collect();
+
+    // The registry of the thread is adopted by a later thread, where
+    // objects of the thread are still found.
+    for (int i = 0; i < 2; i++) {
+        std::thread([] {
+            ObjectHolder a = make_new_held_object();
+            ObjectHolder b = make_new_held_object();
+            set_object_to_table(a.get(), "b", b.get());
+            set_object_to_table(b.get(), "a", a.get());
+        }).join();
+    }
+
+    EXPECT_EQ(4u, collector.collect().collected_objects);
+}
+
+TEST(CycleCollector, CollectsCyclesPinnedInChunks) {
+    auto &collector = CycleCollector::global();
+    collector.collect();
+
+    // More objects than a registry is locked for at once.
+    for (int i = 0; i < 1500; i++) {
+        ObjectHolder a = make_new_held_object();
+        ObjectHolder b = make_new_held_object();
+        set_object_to_table(a.get(), "b", b.get());
+        set_object_to_table(b.get(), "a", a.get());
+    }
+
+    auto stats = collector.collect();
+    EXPECT_EQ(3000u, stats.collected_objects);
+    // Pinning 3000 objects of this thread locks its registry three times.
+    EXPECT_GE(stats.pauses, 4u);
+}
@@ -0,0 +1,95 @@
+#include "../Object.hpp"
+#include "../PoolAllocator.hpp"
+#include "../runtime-internal.hpp"
+#include "gtest/gtest.h"
+
+using namespace ljf;
+using namespace ljf::internal;
+
+namespace {
+LJFHandle add(Context *ctx, Environment *env, const LJFHandle *args) {
+    return ljf_make_fixnum(ljf_fixnum_value(args[0]) +
+                           ljf_fixnum_value(args[1]));
+}
+
+LJFHandle second(Context *ctx, Environment *env, const LJFHandle *args) {
+    return args[1];
+}
+
+LJFHandle count_args(Context *ctx, Environment *env) {
+    auto env_h = ctx->register_temporary_object(env);
+    return ljf_make_fixnum(ljf_array_size(ctx, env_h));
+}
+
+struct FastCallTest : public ::testing::Test {
+    std::unique_ptr<Context> ctx = make_temporary_context();
+};
+} // namespace
+
+TEST_F(FastCallTest, CallFastFunction) {
+    static const auto id = ljf_register_native_fast_function(add, 2);
+    LJFHandle args[] = {ljf_make_fixnum(1), ljf_make_fixnum(2)};
+
+    auto ret = ljf_call_function_fast(ctx.get(), id, ljf_internal_null_handle,
+                                      args, 2);
+    EXPECT_EQ(3, ljf_fixnum_value(ret));
+}
+
+TEST_F(FastCallTest, ReturnedObjectIsHeldByCaller) {
+    static const auto id = ljf_register_native_fast_function(second, 2);
+    LJFHandle args[] = {ljf_make_fixnum(1),
+                        ljf_new_with_native_data(ctx.get(), 42)};
+
+    auto ret = ljf_call_function_fast(ctx.get(), id, ljf_internal_null_handle,
+                                      args, 2);
+    EXPECT_EQ(42, ctx->get_from_handle(ret)->get_native_data());
+}
+
+TEST_F(FastCallTest, CallFastFunctionWithArgumentObject) {
+    static const auto id = ljf_register_native_fast_function(add, 2);
+    ObjectHolder env = create_environment(ctx.get());
+    auto arg = ljf_new(ctx.get());
+    ljf_array_push(ctx.get(), arg, ljf_make_fixnum(3));
+    ljf_array_push(ctx.get(), arg, ljf_make_fixnum(4));
+
+    auto ret =
+        ljf_call_function(ctx.get(), id, env.get_handle(*ctx), arg);
+    EXPECT_EQ(7, ljf_fixnum_value(ret));
+}
+
+TEST_F(FastCallTest, ArityMismatchFallsBackToArgumentObject) {
+    static const auto id = ljf_register_native_function(count_args);
+    ObjectHolder env = create_environment(ctx.get());
+    LJFHandle args[] = {ljf_make_fixnum(1), ljf_make_fixnum(2),
+                        ljf_make_fixnum(3)};
+
+    auto ret =
+        ljf_call_function_fast(ctx.get(), id, env.get_handle(*ctx), args, 3);
+    EXPECT_EQ(3, ljf_fixnum_value(ret));
+}
+
+TEST_F(FastCallTest, FastCallAllocatesNoObject) {
+    static const auto id = ljf_register_native_fast_function(add, 2);
+    LJFHandle args[] = {ljf_make_fixnum(1), ljf_make_fixnum(2)};
+
+    auto live_bytes = pool_statistics().live_bytes;
+    for (int i = 0; i < 1000; i++) {
+        ljf_call_function_fast(ctx.get(), id, ljf_internal_null_handle, args,
+                               2);
+    }
+    EXPECT_EQ(live_bytes, pool_statistics().live_bytes);
+}
+
+TEST_F(FastCallTest, ReturningObjectAllocatesNoOverflow) {
+    static const auto id = ljf_register_native_fast_function(second, 2);
+    LJFHandle args[] = {ljf_make_fixnum(1),
+                        ljf_new_with_native_data(ctx.get(), 42)};
+
+    // The returned object is registered to the caller after the callee
+    // context is released, so the caller pushes it to the handle arena.
+    for (int i = 0; i < 1000; i++) {
+        ljf_call_function_fast(ctx.get(), id, ljf_internal_null_handle, args,
+                               2);
+    }
+    EXPECT_FALSE(ctx->has_overflow());
+}
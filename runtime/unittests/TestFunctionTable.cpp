@@ -0,0 +1,62 @@
+#include "../runtime-internal.hpp"
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+using namespace ljf;
+using namespace ljf::internal;
+
+namespace {
+LJFHandle identity(Context *ctx, Environment *env, const LJFHandle *args) {
+    return args[0];
+}
+} // namespace
+
+TEST(FunctionTable, UnknownIdThrows) {
+    auto ctx = make_temporary_context();
+    EXPECT_THROW(ljf_call_function_fast(ctx.get(), SIZE_MAX,
+                                        ljf_internal_null_handle, nullptr, 0),
+                 ljf::runtime_error);
+}
+
+TEST(FunctionTable, CallWhileOtherThreadsRegister) {
+    constexpr int thread_count = 4;
+    constexpr int function_count = 1000;
+    const auto id = ljf_register_native_fast_function(identity, 1);
+
+    std::vector<std::thread> threads;
+    std::vector<std::vector<FunctionId>> ids(thread_count);
+    for (int t = 0; t < thread_count; t++) {
+        threads.emplace_back([&ids, t] {
+            for (int i = 0; i < function_count; i++) {
+                ids[t].push_back(
+                    ljf_register_native_fast_function(identity, 1));
+            }
+        });
+    }
+
+    auto ctx = make_temporary_context();
+    for (int i = 0; i < function_count; i++) {
+        LJFHandle arg = ljf_make_fixnum(i);
+        EXPECT_EQ(arg, ljf_call_function_fast(ctx.get(), id,
+                                              ljf_internal_null_handle, &arg,
+                                              1));
+    }
+    for (auto &&th : threads) {
+        th.join();
+    }
+
+    std::vector<FunctionId> all_ids;
+    for (auto &&v : ids) {
+        all_ids.insert(all_ids.end(), v.begin(), v.end());
+    }
+    std::sort(all_ids.begin(), all_ids.end());
+    EXPECT_EQ(all_ids.end(),
+              std::adjacent_find(all_ids.begin(), all_ids.end()));
+
+    LJFHandle arg = ljf_make_fixnum(7);
+    EXPECT_EQ(arg, ljf_call_function_fast(ctx.get(), all_ids.back(),
+                                          ljf_internal_null_handle, &arg, 1));
+}
@@ -0,0 +1,140 @@
+#include "../InlineCache.hpp"
+#include "../Object.hpp"
+#include "../runtime-internal.hpp"
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <iterator>
+#include <thread>
+
+using namespace ljf;
+using namespace ljf::internal;
+
+namespace {
+const auto attr = AttributeTraits::or_attr(LJF_ATTR_VISIBLE, LJF_ATTR_C_STR_KEY);
+
+struct InlineCacheTest : public ::testing::Test {
+    std::unique_ptr<Context> ctx = make_temporary_context();
+    // Inline caches are registered to the runtime and must not be freed,
+    // like global variables of compiled modules.
+    LJFInlineCache &cache_memory = *new LJFInlineCache{};
+    InlineCache &cache = InlineCache::from(&cache_memory);
+    const char *key = "x";
+
+    LJFHandle new_object_with_x(const char *first_key = nullptr) {
+        auto obj = ljf_new(ctx.get());
+        if (first_key) {
+            ljf_set(ctx.get(), obj, cast_to_ljf_handle(first_key),
+                    ljf_new(ctx.get()), attr);
+        }
+        ljf_set(ctx.get(), obj, cast_to_ljf_handle(key), ljf_new(ctx.get()),
+                attr);
+        return obj;
+    }
+
+    LJFHandle get_x(LJFHandle obj) {
+        return ljf_get_with_cache(ctx.get(), obj, cast_to_ljf_handle(key), attr,
+                                  internal::ljf_internal_null_handle,
+                                  &cache_memory);
+    }
+};
+} // namespace
+
+TEST_F(InlineCacheTest, Monomorphic) {
+    auto obj1 = new_object_with_x();
+    auto obj2 = new_object_with_x();
+
+    EXPECT_EQ(InlineCache::State::UNINITIALIZED, cache.state());
+    auto x1 = get_x(obj1);
+    auto x2 = get_x(obj2);
+
+    EXPECT_EQ(InlineCache::State::MONOMORPHIC, cache.state());
+    EXPECT_EQ(1, cache.miss_count());
+    EXPECT_EQ(1, cache.hit_count());
+    EXPECT_NE(ctx->get_from_handle(x1), ctx->get_from_handle(x2));
+    EXPECT_EQ(ctx->get_from_handle(x1),
+              ctx->get_from_handle(ljf_get(ctx.get(), obj1,
+                                           cast_to_ljf_handle(key), attr,
+                                           ljf_internal_null_handle)));
+}
+
+TEST_F(InlineCacheTest, Polymorphic) {
+    auto obj1 = new_object_with_x();
+    auto obj2 = new_object_with_x("a");
+
+    get_x(obj1);
+    get_x(obj2);
+    get_x(obj1);
+    get_x(obj2);
+
+    EXPECT_EQ(InlineCache::State::POLYMORPHIC, cache.state());
+    EXPECT_EQ(2, cache.miss_count());
+    EXPECT_EQ(2, cache.hit_count());
+}
+
+TEST_F(InlineCacheTest, Megamorphic) {
+    const char *first_keys[] = {"k0", "k1", "k2", "k3", "k4"};
+    static_assert(std::size(first_keys) > InlineCache::max_entries);
+    for (auto &&first_key : first_keys) {
+        get_x(new_object_with_x(first_key));
+    }
+
+    EXPECT_EQ(InlineCache::State::MEGAMORPHIC, cache.state());
+    EXPECT_EQ(0, cache.hit_count());
+}
+
+TEST_F(InlineCacheTest, NotFound) {
+    auto obj = ljf_new(ctx.get());
+    auto default_value = ljf_new(ctx.get());
+
+    EXPECT_EQ(default_value,
+              ljf_get_with_cache(ctx.get(), obj, cast_to_ljf_handle(key), attr,
+                                 default_value, &cache_memory));
+    EXPECT_EQ(InlineCache::State::UNINITIALIZED, cache.state());
+}
+
+TEST_F(InlineCacheTest, SetAddingKey) {
+    auto obj1 = ljf_new(ctx.get());
+    auto obj2 = ljf_new(ctx.get());
+    auto value = ljf_new(ctx.get());
+
+    ljf_set_with_cache(ctx.get(), obj1, cast_to_ljf_handle(key), value, attr,
+                       &cache_memory);
+    ljf_set_with_cache(ctx.get(), obj2, cast_to_ljf_handle(key), value, attr,
+                       &cache_memory);
+
+    EXPECT_EQ(1, cache.miss_count());
+    EXPECT_EQ(1, cache.hit_count());
+    EXPECT_EQ(ctx->get_from_handle(obj1)->shape(),
+              ctx->get_from_handle(obj2)->shape());
+    EXPECT_EQ(ctx->get_from_handle(value),
+              ctx->get_from_handle(get_x(obj2)));
+}
+
+TEST(InlineCache, BindsKeyWithAttrOfOneThread) {
+    const char *key = "x";
+    const LJFAttribute attrs[] = {
+        AttributeTraits::or_attr(LJF_ATTR_VISIBLE, LJF_ATTR_C_STR_KEY),
+        AttributeTraits::or_attr(LJF_ATTR_HIDDEN, LJF_ATTR_C_STR_KEY),
+    };
+    for (int i = 0; i < 1000; i++) {
+        auto &cache = InlineCache::from(new LJFInlineCache{});
+        std::atomic<bool> start = false;
+        bool bound[2] = {};
+        auto bind = [&](int n) {
+            while (!start) {
+            }
+            bound[n] = cache.bind_key(key, attrs[n]);
+        };
+        std::thread t0{bind, 0};
+        std::thread t1{bind, 1};
+        start = true;
+        t0.join();
+        t1.join();
+
+        // The winner's attr is bound, whichever thread stored attr last.
+        for (int n = 0; n < 2; n++) {
+            EXPECT_EQ(bound[n], cache.bind_key(key, attrs[n]));
+        }
+    }
+}
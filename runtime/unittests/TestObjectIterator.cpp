@@ -18,7 +18,7 @@ TEST(ObjectIterator, HashTable) {
     auto end = range.end();
     auto kv = *iter;
     ASSERT_TRUE(iter != end);
-    EXPECT_EQ(kv.key.get_key_as_c_str(), "elem");
+    EXPECT_STREQ(kv.key.get_key_as_c_str(), "elem");
     EXPECT_EQ(kv.value, elem);
     ++iter;
     ASSERT_TRUE(iter == end);
@@ -33,7 +33,7 @@ TEST(ObjectIterator, TestRange) {
     auto iter = range.begin();
     auto end = range.end();
     auto kv = *iter;
-    EXPECT_EQ(kv.key.get_key_as_c_str(), "elem");
+    EXPECT_STREQ(kv.key.get_key_as_c_str(), "elem");
     EXPECT_EQ(kv.value, elem);
 
     ASSERT_FALSE(iter == end);
@@ -0,0 +1,76 @@
+#include "../PoolAllocator.hpp"
+#include "gtest/gtest.h"
+
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace ljf;
+
+TEST(PoolAllocator, FreedBlockIsReused) {
+    void *p1 = pool_allocate(100);
+    pool_deallocate(p1, 100);
+    void *p2 = pool_allocate(100);
+    EXPECT_EQ(p1, p2);
+    pool_deallocate(p2, 100);
+}
+
+TEST(PoolAllocator, BlocksDoNotOverlap) {
+    constexpr size_t size = 48;
+    std::vector<char *> blocks;
+    std::set<char *> block_set;
+    for (size_t i = 0; i < 10000; i++) {
+        auto p = static_cast<char *>(pool_allocate(size));
+        blocks.push_back(p);
+        block_set.insert(p);
+    }
+    EXPECT_EQ(blocks.size(), block_set.size());
+    for (auto it = block_set.begin(); std::next(it) != block_set.end(); ++it) {
+        EXPECT_LE(*it + size, *std::next(it));
+    }
+    for (auto &&p : blocks) {
+        pool_deallocate(p, size);
+    }
+}
+
+TEST(PoolAllocator, FreeOnOtherThreadReturnsToOwner) {
+    std::vector<void *> blocks;
+    for (size_t i = 0; i < 100; i++) {
+        blocks.push_back(pool_allocate(64));
+    }
+    std::thread th([&] {
+        for (auto &&p : blocks) {
+            pool_deallocate(p, 64);
+        }
+    });
+    th.join();
+
+    std::set<void *> freed(blocks.begin(), blocks.end());
+    size_t reused = 0;
+    std::vector<void *> new_blocks;
+    for (size_t i = 0; i < 100; i++) {
+        auto p = pool_allocate(64);
+        reused += freed.count(p);
+        new_blocks.push_back(p);
+    }
+    EXPECT_EQ(100, reused);
+    for (auto &&p : new_blocks) {
+        pool_deallocate(p, 64);
+    }
+}
+
+TEST(PoolAllocator, Statistics) {
+    auto before = pool_statistics();
+    std::vector<void *> blocks;
+    for (size_t i = 0; i < 1000; i++) {
+        blocks.push_back(pool_allocate(128));
+    }
+    auto during = pool_statistics();
+    EXPECT_EQ(before.live_bytes + 128 * 1000, during.live_bytes);
+    EXPECT_LE(during.live_bytes, during.peak_live_bytes);
+
+    for (auto &&p : blocks) {
+        pool_deallocate(p, 128);
+    }
+    EXPECT_EQ(before.live_bytes, pool_statistics().live_bytes);
+}
@@ -0,0 +1,155 @@
+#include "../CycleCollector.hpp"
+#include "../Object.hpp"
+#include "../ObjectIterator.hpp"
+#include "../Shape.hpp"
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+using namespace ljf;
+using namespace ljf::internal;
+
+namespace {
+const auto c_str_key =
+    AttributeTraits::or_attr(LJF_ATTR_VISIBLE, LJF_ATTR_C_STR_KEY);
+} // namespace
+
+TEST(Shape, EmptyObjectHasRootShape) {
+    ObjectHolder obj = make_new_held_object();
+
+    EXPECT_EQ(Shape::root(), obj->shape());
+    EXPECT_EQ(0, obj->shape()->size());
+}
+
+TEST(Shape, SameInsertionOrderSharesShape) {
+    ObjectHolder obj1 = make_new_held_object();
+    ObjectHolder obj2 = make_new_held_object();
+    ObjectHolder elem = make_new_held_object();
+
+    set_object_to_table(obj1.get(), "x", elem.get());
+    set_object_to_table(obj1.get(), "y", elem.get());
+    set_object_to_table(obj2.get(), "x", elem.get());
+    set_object_to_table(obj2.get(), "y", elem.get());
+
+    EXPECT_EQ(obj1->shape(), obj2->shape());
+    EXPECT_EQ(2, obj1->shape()->size());
+}
+
+TEST(Shape, DifferentInsertionOrderHasDifferentShape) {
+    ObjectHolder obj1 = make_new_held_object();
+    ObjectHolder obj2 = make_new_held_object();
+    ObjectHolder elem = make_new_held_object();
+
+    set_object_to_table(obj1.get(), "x", elem.get());
+    set_object_to_table(obj1.get(), "y", elem.get());
+    set_object_to_table(obj2.get(), "y", elem.get());
+    set_object_to_table(obj2.get(), "x", elem.get());
+
+    EXPECT_NE(obj1->shape(), obj2->shape());
+}
+
+TEST(Shape, OverwriteKeepsShape) {
+    ObjectHolder obj = make_new_held_object();
+    ObjectHolder elem1 = make_new_held_object();
+    ObjectHolder elem2 = make_new_held_object();
+
+    set_object_to_table(obj.get(), "x", elem1.get());
+    auto shape = obj->shape();
+    set_object_to_table(obj.get(), "x", elem2.get());
+
+    EXPECT_EQ(shape, obj->shape());
+    ObjectHolder got = obj->get(
+        "x", AttributeTraits::or_attr(LJF_ATTR_VISIBLE, LJF_ATTR_C_STR_KEY));
+    EXPECT_EQ(elem2, got);
+}
+
+TEST(Shape, VisibleAndHiddenKeysAreDistinct) {
+    ObjectHolder obj = make_new_held_object();
+    ObjectHolder visible = make_new_held_object();
+    ObjectHolder hidden = make_new_held_object();
+
+    set_object_to_table(obj.get(), "x", visible.get());
+    set_object_to_hidden_table(obj.get(), "x", hidden.get());
+
+    EXPECT_EQ(2, obj->shape()->size());
+    EXPECT_EQ(hidden, get_object_from_hidden_table(obj.get(), "x"));
+}
+
+TEST(Shape, LargeShapeFindsKeysOfAncestors) {
+    ObjectHolder obj = make_new_held_object();
+    ObjectHolder elem = make_new_held_object();
+    const auto n = Shape::linear_search_size * 2;
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < n; i++) {
+        keys.push_back("k" + std::to_string(i));
+    }
+    for (auto &&key : keys) {
+        set_object_to_table(obj.get(), key.c_str(), elem.get());
+    }
+
+    auto shape = obj->shape();
+    ASSERT_EQ(n, shape->size());
+    for (size_t i = 0; i < n; i++) {
+        auto key = Key{c_str_key, keys[i].c_str()};
+        EXPECT_EQ(i, shape->find_slot(key));
+        EXPECT_EQ(key, shape->key_at(i));
+        // ancestors
+        EXPECT_EQ(i, shape->parent()->find_slot(key).value_or(i));
+    }
+    EXPECT_FALSE(
+        shape->parent()->find_slot(Key{c_str_key, keys[n - 1].c_str()}));
+}
+
+TEST(Shape, TooManyKeysSwitchToDictionary) {
+    ObjectHolder obj = make_new_held_object();
+    std::vector<std::string> keys;
+    for (size_t i = 0; i <= Shape::max_keys; i++) {
+        keys.push_back("k" + std::to_string(i));
+        obj->set_value(keys.back().c_str(),
+                       Object::ValueType::from_int64(c_str_key, i), c_str_key);
+    }
+
+    EXPECT_TRUE(obj->shape()->is_dictionary());
+    size_t i = 0;
+    for (auto it = obj->iter_hash_table().begin(); it; ++it, ++i) {
+        auto kv = *it;
+        EXPECT_STREQ(keys[i].c_str(), kv.key.get_key_as_c_str());
+    }
+    EXPECT_EQ(keys.size(), i);
+    for (size_t i = 0; i < keys.size(); i++) {
+        auto value = obj->get_unboxed(keys[i].c_str(), c_str_key);
+        ASSERT_TRUE(value);
+        EXPECT_EQ(i, value->as_int64());
+    }
+}
+
+TEST(Shape, ObjectKeySwitchesToDictionary) {
+    ObjectHolder obj = make_new_held_object();
+    ObjectHolder key = make_new_held_object();
+    ObjectHolder elem = make_new_held_object();
+
+    set_object_to_table(obj.get(), "x", elem.get());
+    obj->set(key.get(), elem.get(), LJF_ATTR_OBJECT_KEY);
+
+    EXPECT_TRUE(obj->shape()->is_dictionary());
+    EXPECT_EQ(elem, ObjectHolder(obj->get(key.get(), LJF_ATTR_OBJECT_KEY)));
+    ObjectHolder x = obj->get("x", c_str_key);
+    EXPECT_EQ(elem, x);
+}
+
+TEST(Shape, ObjectKeyIsReleasedWithObject) {
+    auto &collector = CycleCollector::global();
+    collector.collect();
+
+    {
+        // A cycle through a key, which shapes would keep alive forever.
+        ObjectHolder obj = make_new_held_object();
+        ObjectHolder key = make_new_held_object();
+        obj->set(key.get(), make_new_held_object().get(),
+                 LJF_ATTR_OBJECT_KEY);
+        set_object_to_table(key.get(), "obj", obj.get());
+    }
+
+    EXPECT_EQ(3u, collector.collect().collected_objects);
+}
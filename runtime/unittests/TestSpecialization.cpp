@@ -0,0 +1,112 @@
+#include "../Object.hpp"
+#include "../TypeObject.hpp"
+#include "../runtime-internal.hpp"
+#include "gtest/gtest.h"
+
+#include <llvm/AsmParser/Parser.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/Support/SourceMgr.h>
+
+#include <string>
+
+using namespace ljf;
+using namespace ljf::internal;
+
+namespace {
+constexpr auto symbol_key = LJF_ATTR_SYMBOL_KEY;
+
+std::unique_ptr<llvm::Module> parse(llvm::LLVMContext &llvm_context,
+                                    const std::string &ir) {
+    llvm::SMDiagnostic err;
+    auto module = llvm::parseAssemblyString(ir, err, llvm_context);
+    if (!module) {
+        err.print("TestSpecialization", llvm::errs());
+    }
+    return module;
+}
+
+std::vector<std::string> callees(const llvm::Function &fn) {
+    std::vector<std::string> names;
+    for (auto &&inst : llvm::instructions(fn)) {
+        if (auto call = llvm::dyn_cast<llvm::CallInst>(&inst)) {
+            names.push_back(call->getCalledFunction()->getName().str());
+        }
+    }
+    return names;
+}
+} // namespace
+
+TEST(Specialization, AccessesArgumentBySlot) {
+    auto x = ljf_intern_symbol("x");
+    auto y = ljf_intern_symbol("y");
+    ObjectHolder env = make_new_held_object();
+    env->make_environment(nullptr);
+    env->set_value(reinterpret_cast<const void *>(x),
+                   Object::ValueType::from_int64(symbol_key, 1), symbol_key);
+    auto type = env->calculate_type();
+
+    // x is in the shape, y is not.
+    llvm::LLVMContext llvm_context;
+    auto module = parse(llvm_context, R"(
+@x = internal constant i64 )" + std::to_string(x) + R"(
+@y = internal constant i64 )" + std::to_string(y) + R"(
+declare i64 @ljf_environment_get_int64(i8*, i8*, i64, i64, i64)
+declare i64 @naive(i8*, i8*)
+define i64 @f(i8* %ctx, i8* %env) {
+  %v = alloca i64
+  %x = load i64, i64* @x
+  %y = load i64, i64* @y
+  %a = call i64 @ljf_environment_get_int64(i8* %ctx, i8* %env, i64 %x, i64 16, i64 0)
+  %b = call i64 @ljf_environment_get_int64(i8* %ctx, i8* %env, i64 %y, i64 16, i64 0)
+  %c = add i64 %a, %b
+  store i64 %c, i64* %v
+  ret i64 %c
+}
+)");
+    ASSERT_TRUE(module);
+    auto fn = module->getFunction("f");
+    specialize_function_for_type(*fn, *module->getFunction("naive"), *type);
+
+    EXPECT_FALSE(llvm::verifyModule(*module, &llvm::errs()));
+    EXPECT_EQ((std::vector<std::string>{
+                  "ljf_internal_environment_type_id",
+                  "ljf_internal_environment_get_int64_at",
+                  "ljf_environment_get_int64",
+                  "naive",
+              }),
+              callees(*fn));
+    // Allocas stay in the entry block.
+    EXPECT_TRUE(llvm::isa<llvm::AllocaInst>(fn->getEntryBlock().front()));
+}
+
+TEST(Specialization, SlotAccessFallsBackToKeyOnOtherShape) {
+    auto ctx = make_temporary_context();
+    auto x = ljf_intern_symbol("x");
+    auto y = ljf_intern_symbol("y");
+    ObjectHolder env = make_new_held_object();
+    env->make_environment(nullptr);
+    ljf_environment_set_int64(ctx.get(), env.get(), x, 1, symbol_key);
+    auto shape = env->shape();
+    auto slot = env->find_slot(reinterpret_cast<const void *>(x), symbol_key);
+    ASSERT_TRUE(slot);
+
+    EXPECT_EQ(1, ljf_internal_environment_get_int64_at(
+                     ctx.get(), env.get(), x, symbol_key, 0, shape, *slot));
+    ljf_internal_environment_set_int64_at(ctx.get(), env.get(), x, 2,
+                                          symbol_key, shape, *slot);
+
+    // The shape changes, so the key is looked up.
+    ljf_environment_set_int64(ctx.get(), env.get(), y, 3, symbol_key);
+    EXPECT_EQ(2, ljf_internal_environment_get_int64_at(
+                     ctx.get(), env.get(), x, symbol_key, 0, shape, *slot));
+    ljf_internal_environment_set_int64_at(ctx.get(), env.get(), y, 4,
+                                          symbol_key, shape, *slot);
+    EXPECT_EQ(2, ljf_environment_get_int64(ctx.get(), env.get(), x,
+                                           symbol_key, 0));
+    EXPECT_EQ(4, ljf_environment_get_int64(ctx.get(), env.get(), y,
+                                           symbol_key, 0));
+}
@@ -0,0 +1,54 @@
+#include "../Object.hpp"
+#include "../Symbol.hpp"
+#include "gtest/gtest.h"
+
+#include <string>
+
+using namespace ljf;
+using namespace ljf::internal;
+
+TEST(Symbol, SameNameIsSameSymbol) {
+    std::string name1 = "symbol-test";
+    std::string name2 = "symbol-test";
+
+    auto sym1 = Symbol::intern(name1);
+    auto sym2 = Symbol::intern(name2);
+
+    EXPECT_EQ(sym1, sym2);
+    EXPECT_NE(sym1, Symbol::intern("symbol-test-other"));
+    EXPECT_STREQ("symbol-test", sym1->c_str());
+}
+
+TEST(Symbol, SymbolKeyAndCStrKeyAreSameKey) {
+    ObjectHolder obj = make_new_held_object();
+    ObjectHolder elem = make_new_held_object();
+
+    auto sym = Symbol::intern("x");
+    obj->set(sym, elem.get(),
+             AttributeTraits::or_attr(LJF_ATTR_VISIBLE, LJF_ATTR_SYMBOL_KEY));
+
+    // a different buffer which has same contents
+    std::string name = "x";
+    ObjectHolder got = obj->get(
+        name.c_str(),
+        AttributeTraits::or_attr(LJF_ATTR_VISIBLE, LJF_ATTR_C_STR_KEY));
+    EXPECT_EQ(elem.get(), got.get());
+    EXPECT_EQ(1, obj->shape()->size());
+}
+
+TEST(Symbol, LookupDoesNotIntern) {
+    ObjectHolder obj = make_new_held_object();
+    ObjectHolder elem = make_new_held_object();
+    const auto attr =
+        AttributeTraits::or_attr(LJF_ATTR_VISIBLE, LJF_ATTR_C_STR_KEY);
+    auto &table = SymbolTable::global();
+
+    const auto size = table.size();
+    EXPECT_FALSE(obj->get_value("symbol-test-lookup-only", attr));
+    EXPECT_EQ(size, table.size());
+
+    // Stored keys are interned.
+    obj->set("symbol-test-stored", elem.get(), attr);
+    EXPECT_EQ(size + 1, table.size());
+    EXPECT_TRUE(obj->shape()->key_at(0).is_symbol_key());
+}
@@ -0,0 +1,79 @@
+#include "../ThinLock.hpp"
+#include "gtest/gtest.h"
+
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace ljf;
+
+TEST(ThinLock, RecursiveLockIsNotInflated) {
+    ThinLock lock;
+
+    lock.lock();
+    lock.lock();
+    EXPECT_TRUE(lock.try_lock());
+    lock.unlock();
+    lock.unlock();
+    lock.unlock();
+
+    EXPECT_FALSE(lock.is_inflated());
+}
+
+TEST(ThinLock, DeepRecursionInflates) {
+    ThinLock lock;
+    constexpr size_t depth = 100;
+
+    for (size_t i = 0; i < depth; i++) {
+        lock.lock();
+    }
+    EXPECT_TRUE(lock.is_inflated());
+    for (size_t i = 0; i < depth; i++) {
+        lock.unlock();
+    }
+
+    // The lock is released.
+    bool locked = false;
+    std::thread th([&] {
+        locked = lock.try_lock();
+        if (locked) {
+            lock.unlock();
+        }
+    });
+    th.join();
+    EXPECT_TRUE(locked);
+}
+
+TEST(ThinLock, TryLockFailsWhileOtherThreadHolds) {
+    ThinLock lock;
+
+    std::lock_guard lk{lock};
+    bool locked = true;
+    std::thread th([&] { locked = lock.try_lock(); });
+    th.join();
+
+    EXPECT_FALSE(locked);
+}
+
+TEST(ThinLock, MutualExclusion) {
+    ThinLock lock;
+    size_t counter = 0;
+    constexpr size_t thread_num = 4;
+    constexpr size_t loop_num = 10000;
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < thread_num; i++) {
+        threads.emplace_back([&] {
+            for (size_t j = 0; j < loop_num; j++) {
+                std::lock_guard lk1{lock};
+                std::lock_guard lk2{lock};
+                ++counter;
+            }
+        });
+    }
+    for (auto &&th : threads) {
+        th.join();
+    }
+
+    EXPECT_EQ(thread_num * loop_num, counter);
+}
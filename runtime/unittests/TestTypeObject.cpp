@@ -1,9 +1,13 @@
-#include "../TypeObject.hpp"
+#include "../Object.hpp"
 #include "gtest/gtest.h"
 
+#include <algorithm>
+#include <set>
+#include <thread>
+#include <vector>
+
 using namespace ljf::internal;
 
-// FRIEND_TEST (private member access test) need defining test in namespace
 namespace ljf {
 
 constexpr auto create_obj = []() {
@@ -17,14 +21,7 @@ constexpr auto create_obj = []() {
     return obj;
 };
 
-// TEST(calculate_type, Test) {
-
-//     auto obj1 = create_obj();
-
-//     obj1->calculate_type();
-
-//     EXPECT_EQ(*obj1->calculate_type(), );
-// }
+constexpr auto c_str_key = LJF_ATTR_C_STR_KEY;
 
 TEST(calculate_type, TestEquivalence) {
 
@@ -33,7 +30,62 @@ TEST(calculate_type, TestEquivalence) {
 
     EXPECT_NE(obj1, obj2);
     EXPECT_EQ(obj1->calculate_type(), obj2->calculate_type());
-    EXPECT_EQ(*obj1->calculate_type(), *obj2->calculate_type());
+    EXPECT_EQ(obj1->calculate_type()->shape(), obj1->shape());
+}
+
+TEST(calculate_type, TestNewObject) {
+    ObjectHolder obj = make_new_held_object();
+    EXPECT_EQ(obj->calculate_type(), TypeObject::root());
+}
+
+TEST(calculate_type, TestValueKind) {
+    ObjectHolder obj = make_new_held_object();
+    obj->set_value("x", Object::ValueType::from_int64(c_str_key, 1),
+                   c_str_key);
+    auto int_type = obj->calculate_type();
+    EXPECT_EQ(int_type->slot_kind(0), ValueKind::int64);
+
+    obj->set_value("x", Object::ValueType::from_int64(c_str_key, 2),
+                   c_str_key);
+    EXPECT_EQ(obj->calculate_type(), int_type);
+
+    obj->set_value("x", Object::ValueType::from_double(c_str_key, 1.5),
+                   c_str_key);
+    EXPECT_NE(obj->calculate_type(), int_type);
+    EXPECT_EQ(obj->calculate_type()->slot_kind(0), ValueKind::double_value);
+
+    // Types reached by different transitions are the same object.
+    obj->set_value("x", Object::ValueType::from_int64(c_str_key, 3),
+                   c_str_key);
+    EXPECT_EQ(obj->calculate_type(), int_type);
+}
+
+TEST(calculate_type, TestArrayKind) {
+    ObjectHolder obj = make_new_held_object();
+    ObjectHolder elem = make_new_held_object();
+    EXPECT_EQ(obj->calculate_type()->array_kind(), ValueKind::none);
+
+    obj->array_push_value(Object::ValueType::from_int64(LJF_ATTR_DEFAULT, 1));
+    EXPECT_EQ(obj->calculate_type()->array_kind(), ValueKind::int64);
+
+    obj->array_push(elem.get());
+    EXPECT_EQ(obj->calculate_type()->array_kind(), ValueKind::mixed);
+}
+
+TEST(calculate_type, TestTypeFollowsMutation) {
+    ObjectHolder obj = make_new_held_object();
+    ObjectHolder value = make_new_held_object();
+    obj->array_push_value(Object::ValueType::from_int64(LJF_ATTR_DEFAULT, 1));
+    auto type = obj->calculate_type();
+
+    // A type read before a mutation must not be returned after it.
+    obj->array_set_at(0, value.get());
+    EXPECT_NE(obj->calculate_type(), type);
+    type = obj->calculate_type();
+
+    set_object_to_table(obj.get(), "added", value.get());
+    EXPECT_NE(obj->calculate_type(), type);
+    EXPECT_EQ(obj->calculate_type()->shape(), obj->shape());
 }
 
 TEST(calculate_type, TestCircularReference) {
@@ -45,11 +97,87 @@ TEST(calculate_type, TestCircularReference) {
     set_object_to_table(a.get(), "b", b.get());
     set_object_to_table(b.get(), "obj", obj.get());
 
-    obj->calculate_type();
-
+    // Referenced objects are not traversed.
     auto b_type = b->calculate_type();
-    EXPECT_FALSE(b_type->is_circular_reference());
-    EXPECT_TRUE(b_type->hash_table_types_.at("obj")->is_circular_reference());
+    EXPECT_EQ(b_type->slot_kind(0), ValueKind::object);
+    EXPECT_NE(b_type, obj->calculate_type());
+}
+
+TEST(calculate_type, TestSwap) {
+    auto obj1 = create_obj();
+    ObjectHolder obj2 = make_new_held_object();
+    auto type = obj1->calculate_type();
+
+    obj1->swap(*obj2);
+    EXPECT_EQ(obj1->calculate_type(), TypeObject::root());
+    EXPECT_EQ(obj2->calculate_type(), type);
+}
+
+TEST(calculate_type, TestId) {
+    ObjectHolder obj = make_new_held_object();
+    EXPECT_EQ(TypeObject::root()->id(), 0u);
+
+    obj->set_value("id-test", Object::ValueType::from_int64(c_str_key, 1),
+                   c_str_key);
+    auto type = obj->calculate_type();
+    EXPECT_NE(type->id(), TypeObject::root()->id());
+    EXPECT_EQ(create_obj()->calculate_type()->id(),
+              create_obj()->calculate_type()->id());
+}
+
+TEST(calculate_type, TestConcurrentIntern) {
+    constexpr int n_threads = 8;
+    std::vector<const TypeObject *> types(n_threads);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < n_threads; i++) {
+        threads.emplace_back([&types, i] {
+            ObjectHolder obj = make_new_held_object();
+            for (auto key : {"concurrent-1", "concurrent-2", "concurrent-3"}) {
+                obj->set_value(key, Object::ValueType::from_int64(c_str_key, i),
+                               c_str_key);
+            }
+            types[i] = obj->calculate_type();
+        });
+    }
+    for (auto &th : threads) {
+        th.join();
+    }
+    for (auto type : types) {
+        EXPECT_EQ(type, types[0]);
+    }
+}
+
+TEST(calculate_type, TestTypesPerShapeAreLimited) {
+    // 2^6 combinations of slot kinds of one shape.
+    const char *keys[] = {"limit-0", "limit-1", "limit-2",
+                          "limit-3", "limit-4", "limit-5"};
+    std::set<const TypeObject *> types;
+    const Shape *shape = nullptr;
+    for (int bits = 0; bits < 64; bits++) {
+        ObjectHolder obj = make_new_held_object();
+        for (int k = 0; k < 6; k++) {
+            obj->set_value(keys[k], Object::ValueType::from_int64(c_str_key, 0),
+                           c_str_key);
+        }
+        for (int k = 0; k < 6; k++) {
+            if (bits & (1 << k)) {
+                obj->set_value(keys[k],
+                               Object::ValueType::from_double(c_str_key, 0),
+                               c_str_key);
+            }
+        }
+        shape = obj->shape();
+        types.insert(obj->calculate_type());
+    }
+
+    EXPECT_LE(types.size(), TypeObject::max_types_per_shape + 1);
+    auto generic = std::find_if(types.begin(), types.end(), [](auto type) {
+        return type->slot_kind(0) == ValueKind::mixed;
+    });
+    ASSERT_NE(generic, types.end());
+    EXPECT_EQ(shape, (*generic)->shape());
+    // Stores keep the generic type.
+    EXPECT_EQ(*generic, (*generic)->with_slot(shape, 0, ValueKind::int64));
 }
 
 } // namespace ljf
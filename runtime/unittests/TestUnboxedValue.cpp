@@ -0,0 +1,120 @@
+#include "../Object.hpp"
+#include "../ljf-system-property.hpp"
+#include "../runtime-internal.hpp"
+#include "gtest/gtest.h"
+
+using namespace ljf;
+using namespace ljf::internal;
+
+namespace {
+const auto attr = AttributeTraits::or_attr(LJF_ATTR_VISIBLE, LJF_ATTR_C_STR_KEY);
+
+struct UnboxedValueTest : public ::testing::Test {
+    std::unique_ptr<Context> ctx = make_temporary_context();
+};
+} // namespace
+
+TEST_F(UnboxedValueTest, Int64) {
+    auto obj = ljf_new(ctx.get());
+    ljf_set_int64(ctx.get(), obj, cast_to_ljf_handle("x"), -42, attr);
+
+    EXPECT_EQ(-42, ljf_get_int64(ctx.get(), obj, cast_to_ljf_handle("x"), attr,
+                                 0));
+    EXPECT_EQ(7, ljf_get_int64(ctx.get(), obj, cast_to_ljf_handle("y"), attr,
+                               7));
+}
+
+TEST_F(UnboxedValueTest, Double) {
+    auto obj = ljf_new(ctx.get());
+    ljf_set_double(ctx.get(), obj, cast_to_ljf_handle("x"), 1.5, attr);
+
+    EXPECT_EQ(1.5, ljf_get_double(ctx.get(), obj, cast_to_ljf_handle("x"),
+                                  attr, 0.0));
+    EXPECT_THROW(
+        ljf_get_int64(ctx.get(), obj, cast_to_ljf_handle("x"), attr, 0),
+        ljf::runtime_error);
+}
+
+TEST_F(UnboxedValueTest, GetBoxesValue) {
+    auto obj = ljf_new(ctx.get());
+    ljf_set_int64(ctx.get(), obj, cast_to_ljf_handle("x"), 42, attr);
+
+    auto boxed = ljf_get(ctx.get(), obj, cast_to_ljf_handle("x"), attr,
+                         ljf_internal_null_handle);
+    ASSERT_NE(ljf_internal_null_handle, boxed);
+    auto boxed_obj = ctx->get_from_handle(boxed);
+    EXPECT_EQ(42, boxed_obj->get_native_data());
+    ObjectHolder data =
+        get_object_from_hidden_table(boxed_obj, ljf_native_value_int64);
+    ASSERT_TRUE(data);
+    EXPECT_EQ(42, data->get_native_data());
+}
+
+TEST_F(UnboxedValueTest, BoxedValueIsNotUnboxed) {
+    auto obj = ljf_new(ctx.get());
+    ljf_set(ctx.get(), obj, cast_to_ljf_handle("x"), ljf_new(ctx.get()), attr);
+
+    EXPECT_THROW(
+        ljf_get_int64(ctx.get(), obj, cast_to_ljf_handle("x"), attr, 0),
+        ljf::runtime_error);
+}
+
+TEST_F(UnboxedValueTest, Environment) {
+    ObjectHolder env = create_environment(ctx.get());
+    ljf_environment_set_int64(ctx.get(), env.get(), cast_to_ljf_handle("i"), 3,
+                              attr);
+    ljf_environment_set_double(ctx.get(), env.get(), cast_to_ljf_handle("d"),
+                               0.25, attr);
+
+    EXPECT_EQ(3, ljf_environment_get_int64(ctx.get(), env.get(),
+                                           cast_to_ljf_handle("i"), attr, 0));
+    EXPECT_EQ(0.25,
+              ljf_environment_get_double(ctx.get(), env.get(),
+                                         cast_to_ljf_handle("d"), attr, 0.0));
+}
+
+TEST(Fixnum, Encoding) {
+    EXPECT_TRUE(ljf_is_fixnum(ljf_make_fixnum(0)));
+    EXPECT_EQ(-5, ljf_fixnum_value(ljf_make_fixnum(-5)));
+    EXPECT_EQ(INT64_MAX >> 1, ljf_fixnum_value(ljf_make_fixnum(INT64_MAX >> 1)));
+    EXPECT_EQ(INT64_MIN >> 1, ljf_fixnum_value(ljf_make_fixnum(INT64_MIN >> 1)));
+    EXPECT_FALSE(ljf_fixnum_fits(INT64_MAX));
+}
+
+TEST_F(UnboxedValueTest, FixnumIsStoredUnboxed) {
+    auto obj = ljf_new(ctx.get());
+    ljf_set(ctx.get(), obj, cast_to_ljf_handle("x"), ljf_make_fixnum(42),
+            attr);
+
+    EXPECT_EQ(42, ljf_get_int64(ctx.get(), obj, cast_to_ljf_handle("x"), attr,
+                                0));
+    auto got = ljf_get(ctx.get(), obj, cast_to_ljf_handle("x"), attr,
+                       ljf_internal_null_handle);
+    ASSERT_TRUE(ljf_is_fixnum(got));
+    EXPECT_EQ(42, ljf_fixnum_value(got));
+}
+
+TEST_F(UnboxedValueTest, LargeInt64IsBoxed) {
+    auto obj = ljf_new(ctx.get());
+    ljf_set_int64(ctx.get(), obj, cast_to_ljf_handle("x"), INT64_MAX, attr);
+
+    auto got = ljf_get(ctx.get(), obj, cast_to_ljf_handle("x"), attr,
+                       ljf_internal_null_handle);
+    ASSERT_FALSE(ljf_is_fixnum(got));
+    EXPECT_EQ(INT64_MAX, ctx->get_from_handle(got)->get_native_data());
+}
+
+TEST_F(UnboxedValueTest, FixnumInArray) {
+    auto array = ljf_new(ctx.get());
+    ljf_array_push(ctx.get(), array, ljf_make_fixnum(1));
+    ljf_array_push(ctx.get(), array, ljf_new_with_native_data(ctx.get(), 2));
+
+    auto elem0 = ljf_array_get(ctx.get(), array, 0);
+    ASSERT_TRUE(ljf_is_fixnum(elem0));
+    EXPECT_EQ(1, ljf_fixnum_value(elem0));
+    auto elem1 = ljf_array_get(ctx.get(), array, 1);
+    EXPECT_EQ(2, ctx->get_from_handle(elem1)->get_native_data());
+
+    // boxed if it is used as an object
+    EXPECT_EQ(1, ctx->get_from_handle(elem0)->get_native_data());
+}
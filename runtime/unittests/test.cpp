@@ -56,3 +56,70 @@ TEST_F(LJFEnvironment, GetNotExistValue) {
               ljf_environment_get(ctx.get(), env, cast_to_ljf_handle("obj"),
                                   LJF_ATTR_VISIBLE, obj_handle));
 }
+
+TEST_F(LJFEnvironment, ResolveOuterValue) {
+    ljf_environment_set(ctx.get(), env0, cast_to_ljf_handle("obj"),
+                        obj.get_handle(*ctx), LJF_ATTR_VISIBLE);
+
+    uint64_t depth = 0, slot = 0, shape = 0;
+    ASSERT_TRUE(ljf_environment_resolve(ctx.get(), env,
+                                        cast_to_ljf_handle("obj"),
+                                        LJF_ATTR_VISIBLE, &depth, &slot,
+                                        &shape));
+    ASSERT_EQ(1u, depth);
+    LJFHandle value;
+    ASSERT_TRUE(
+        ljf_environment_get_slot(ctx.get(), env, depth, slot, shape, &value));
+    ASSERT_EQ(obj, ctx->get_from_handle(value));
+
+    ObjectHolder obj2 = make_new_held_object();
+    ASSERT_TRUE(ljf_environment_set_slot(ctx.get(), env, depth, slot, shape,
+                                         obj2.get_handle(*ctx),
+                                         LJF_ATTR_VISIBLE));
+    ASSERT_EQ(obj2, ctx->get_from_handle(ljf_environment_get(
+                        ctx.get(), env0, cast_to_ljf_handle("obj"),
+                        LJF_ATTR_VISIBLE, ljf_internal_null_handle)));
+}
+
+TEST_F(LJFEnvironment, ResolveNotExistValue) {
+    uint64_t depth = 0, slot = 0, shape = 0;
+    ASSERT_FALSE(ljf_environment_resolve(ctx.get(), env,
+                                         cast_to_ljf_handle("obj"),
+                                         LJF_ATTR_VISIBLE, &depth, &slot,
+                                         &shape));
+}
+
+TEST_F(LJFEnvironment, SlotOfOtherShapeFails) {
+    ljf_environment_set(ctx.get(), env0, cast_to_ljf_handle("obj"),
+                        obj.get_handle(*ctx), LJF_ATTR_VISIBLE);
+    uint64_t depth = 0, slot = 0, shape = 0;
+    ASSERT_TRUE(ljf_environment_resolve(ctx.get(), env,
+                                        cast_to_ljf_handle("obj"),
+                                        LJF_ATTR_VISIBLE, &depth, &slot,
+                                        &shape));
+
+    // The slot of obj belongs to another variable in a frame of another
+    // shape.
+    ljf_environment_set(ctx.get(), env, cast_to_ljf_handle("other"),
+                        ljf_new(ctx.get()), LJF_ATTR_VISIBLE);
+    ljf_environment_set(ctx.get(), env0, cast_to_ljf_handle("other"),
+                        ljf_new(ctx.get()), LJF_ATTR_VISIBLE);
+    LJFHandle value;
+    EXPECT_FALSE(ljf_environment_get_slot(ctx.get(), env, depth, slot, shape,
+                                          &value));
+    EXPECT_FALSE(ljf_environment_set_slot(ctx.get(), env, depth, slot, shape,
+                                          obj.get_handle(*ctx),
+                                          LJF_ATTR_VISIBLE));
+}
+
+TEST_F(LJFEnvironment, CalleeEnvironmentHasArgument) {
+    auto arg = ljf_new(ctx.get());
+    ljf_set(ctx.get(), arg, cast_to_ljf_handle("obj"), obj.get_handle(*ctx),
+            LJF_ATTR_VISIBLE);
+    ObjectHolder callee =
+        create_callee_environment(env, ctx->get_from_handle(arg));
+
+    ASSERT_EQ(obj, ctx->get_from_handle(ljf_environment_get(
+                       ctx.get(), callee, cast_to_ljf_handle("obj"),
+                       LJF_ATTR_VISIBLE, ljf_internal_null_handle)));
+}